@@ -0,0 +1,31 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+/*
+ * Counter of the heap allocations done by GMP, to check that the scan does no allocation per
+ * candidate once its buffers are sized. Installed through `mp_set_memory_functions`, blocks are
+ * still allocated with malloc so blocks allocated before the installation remain valid.
+ */
+
+#include <stdint.h>
+
+/*
+* Allocations done by GMP since `alloc_counter_install`.
+* allocs : number of allocations (malloc).
+* reallocs : number of reallocations (growth of an existing value).
+*/
+struct alloc_counts {
+	uint64_t allocs;
+	uint64_t reallocs;
+};
+
+/*
+* Route the allocations of GMP through the counter. Counting costs an atomic increment per
+* allocation, so it is only installed when the counts are reported.
+*/
+void alloc_counter_install();
+
+// Current counts, from every thread
+alloc_counts alloc_counter_get();
+
+#endif //! ALLOC_COUNTER_HPP
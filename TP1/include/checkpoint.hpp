@@ -0,0 +1,103 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+/*
+ * Checkpoints of a streaming run (see `Pipeline`), so that a killed run can be resumed without
+ * scanning again what was done. The writer of the pipeline writes the tasks in ascending order, so
+ * the progress of a run is a single value, the high-water mark: every value of the intervals below
+ * it is scanned and its primes are written. Intervals entirely below it are completed, the interval
+ * holding it is in flight up to it.
+ *
+ * Primes are appended to a results file in the binary format of prime-file.hpp. Every
+ * CHECKPOINT_PERIOD seconds the results are flushed, then the high-water mark and the length of the
+ * results file are saved to <results>.ckpt (written aside and renamed, so it is never torn). A
+ * resumed run cuts the results file back to the saved length, dropping primes written after the
+ * checkpoint, and scans again from the high-water mark: no prime is missed or written twice.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <gmpxx.h>
+
+#include "miller-rabin-gmp.hpp"
+#include "prime-file.hpp"
+
+// Seconds between two checkpoints
+#define CHECKPOINT_PERIOD 1
+// Suffix of the checkpoint file, after the name of the results file
+#define CHECKPOINT_SUFFIX ".ckpt"
+
+class Checkpoint {
+public:
+	/*
+	* Checkpoints of the run on the interval file `input` with `test` and `rounds`, the primes being
+	* appended to the file `results`.
+	*/
+	Checkpoint(const std::string& results, const std::string& input, prime_test test, size_t rounds);
+
+	Checkpoint(const Checkpoint&) = delete;
+	Checkpoint& operator=(const Checkpoint&) = delete;
+
+	/*
+	* Open the results file. When `resume` is true, the last checkpoint is loaded and the results are
+	* cut back to it, otherwise the results file is truncated.
+	* return : false if the results file can't be opened, or if `resume` is true and there is no
+	* checkpoint of the same input file, test and rounds (see `error`).
+	*/
+	bool open(bool resume);
+
+	// Reason of the failure of `open`
+	inline const std::string& error() const {
+		return mError;
+	}
+
+	// True if the run goes on from a checkpoint of a run which wrote primes, its high-water mark is
+	// then `high_water`
+	inline bool resumed() const {
+		return mResumed;
+	}
+	inline const mpz_class& high_water() const {
+		return mHighWater;
+	}
+
+	// Writer appending to the results file
+	inline PrimeWriter* writer() {
+		return mWriter.get();
+	}
+
+	/*
+	* Record that every value below `high_water` is done, its primes being given to `writer`. A
+	* checkpoint is saved if the last one is older than CHECKPOINT_PERIOD or if `force` is set.
+	*/
+	void save(const mpz_class& high_water, bool force);
+
+	/*
+	* Flush and close the results file, then copy every prime of it on `out`: the file as it is if
+	* `binary` is set, in decimal otherwise, each prime followed by `separator`.
+	* return : false if the results file can't be read back.
+	*/
+	bool dump(std::ostream& out, bool binary, char separator);
+
+private:
+	bool load();
+	void store();
+
+	std::string mResults;
+	std::string mInput;	   //! "<input path> <input size>"
+	std::string mTest;
+	size_t mRounds;
+	std::ofstream mFile;
+	std::unique_ptr<PrimeWriter> mWriter;
+	mpz_class mHighWater;  //! every value below is done
+	bool mHasHighWater;	   //! false until the first task is written
+	uint64_t mLength;	   //! length of the results file at the last checkpoint
+	bool mResumed;
+	std::string mError;
+	std::chrono::steady_clock::time_point mLast; //! time of the last checkpoint
+};
+
+#endif //! CHECKPOINT_HPP
@@ -0,0 +1,41 @@
+#ifndef COST_MODEL_HPP
+#define COST_MODEL_HPP
+
+/*
+ * Cost model of the interval scan: how long `scan_interval` is expected to take on an interval,
+ * from its length and the bit size of its values. Measured at startup by a micro-benchmark of the
+ * scan at a few bit sizes, then interpolated (power law) between them.
+ */
+
+#include <vector>
+#include <stdint.h>
+#include <gmpxx.h>
+
+/*
+* Scan cost measured at one bit size.
+* bits : bit size of the values.
+* segment : seconds to sieve one segment (SIEVE_SEGMENT_SIZE values, or less), whatever the number
+* of values tested.
+* value : seconds per value of the interval, sieve excluded (mostly miller-rabin on the survivors).
+*/
+struct cost_sample {
+	size_t bits;
+	double segment;
+	double value;
+};
+
+/*
+* Calibrated cost model.
+* small : samples of values fitting in 64 bits (exact 64 bits test), increasing bit sizes.
+* large : samples of larger values (GMP test), increasing bit sizes.
+*/
+struct cost_model {
+	std::vector<cost_sample> small;
+	std::vector<cost_sample> large;
+};
+
+cost_model* cost_model_calibrate(size_t rounds, const std::vector<uint32_t>* sieve_primes);
+double cost_model_estimate(const cost_model* model, const mpz_class& from, const mpz_class& to);
+void cost_model_print(const cost_model* model);
+
+#endif //! COST_MODEL_HPP
@@ -0,0 +1,99 @@
+#ifndef FIXED_UINT_HPP
+#define FIXED_UINT_HPP
+
+/*
+ * Fixed width unsigned integer of N 64 bits limbs (little endian, same layout as GMP limbs), for
+ * the values walked by the interval loops. Its size is known at compile time, so an addition or a
+ * comparison is a few instructions on limbs kept on the stack, without any GMP call, size
+ * normalisation or allocation. Values only go through GMP when they are converted to or from
+ * `mpz_t`.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+static_assert(GMP_LIMB_BITS == 64 && GMP_NAIL_BITS == 0, "FixedUInt expects 64 bits GMP limbs");
+
+// Largest limb count of the values walked with a FixedUInt, larger values stay `mpz_class`
+#define FIXED_UINT_MAX_LIMBS 16
+
+template <size_t N>
+class FixedUInt {
+public:
+	FixedUInt()
+		: mLimbs{} {
+	}
+
+	/*
+	* Set to `value`.
+	* return : false if `value` is negative or does not fit in N limbs, the value is then unchanged.
+	*/
+	bool set(const mpz_t value) {
+		size_t size = mpz_size(value);
+		if (mpz_sgn(value) < 0 || size > N)
+			return false;
+		const mp_limb_t* limbs = mpz_limbs_read(value);
+		for (size_t i = 0; i < N; i++)
+			mLimbs[i] = i < size ? limbs[i] : 0;
+		return true;
+	}
+
+	/*
+	* Copy the value into `value`, which is only allocated the first time it gets N limbs.
+	*/
+	inline void get(mpz_t value) const {
+		mp_limb_t* limbs = mpz_limbs_write(value, N);
+#pragma GCC unroll 16
+		for (size_t i = 0; i < N; i++)
+			limbs[i] = mLimbs[i];
+		mpz_limbs_finish(value, N);
+	}
+
+	// Limbs of the value, least significant first
+	inline const uint64_t* limbs() const {
+		return mLimbs;
+	}
+
+	/*
+	* Add `value`, the result must fit in N limbs.
+	*/
+	inline void add(uint64_t value) {
+		uint64_t carry = value;
+#pragma GCC unroll 16
+		for (size_t i = 0; i < N; i++)
+			carry = __builtin_add_overflow(mLimbs[i], carry, &mLimbs[i]);
+	}
+
+	/*
+	* Returns this - `other`, or UINT64_MAX if it does not fit in 64 bits. The value must not be
+	* lower than `other`.
+	*/
+	inline uint64_t distance(const FixedUInt& other) const {
+		uint64_t low;
+		uint64_t borrow = __builtin_sub_overflow(mLimbs[0], other.mLimbs[0], &low);
+		bool high = false;
+#pragma GCC unroll 16
+		for (size_t i = 1; i < N; i++) {
+			uint64_t limb;
+			uint64_t under = __builtin_sub_overflow(mLimbs[i], other.mLimbs[i], &limb);
+			under |= __builtin_sub_overflow(limb, borrow, &limb);
+			high |= limb != 0;
+			borrow = under;
+		}
+		return high ? UINT64_MAX : low;
+	}
+
+	inline bool operator<(const FixedUInt& other) const {
+		for (size_t i = N; i-- > 0;) {
+			if (mLimbs[i] != other.mLimbs[i])
+				return mLimbs[i] < other.mLimbs[i];
+		}
+		return false;
+	}
+
+private:
+	uint64_t mLimbs[N];
+};
+
+#endif //! FIXED_UINT_HPP
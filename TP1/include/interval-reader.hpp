@@ -0,0 +1,107 @@
+#ifndef INTERVAL_READER_HPP
+#define INTERVAL_READER_HPP
+
+/*
+ * Parallel reader of interval files. Expected format is the following :
+ * A B
+ * C D
+ * ...
+ * Meaning intervals are : 
+ * [[A, B], [C, D], ...] 
+ *
+ * The file is memory mapped and cut at line boundaries into parts, each part being parsed by its
+ * own thread, with no stream or line buffer in between. Each bound is copied from the mapping into
+ * a buffer reused by the whole part to be NUL terminated for `mpz_set_str`: writing the terminator
+ * in a private writable mapping instead was measured slower, every page being copied on write.
+ */
+
+#include <string>
+#include <vector>
+#include <gmpxx.h>
+
+class IntervalReader {
+public:
+	/*
+	* Map the file at `path` and cut it into `nb_parts` parts of about the same size, each ending at
+	* the end of a line.
+	*/
+	IntervalReader(const std::string& path, int nb_parts);
+
+	/*
+	* Unmap the file.
+	*/
+	~IntervalReader();
+
+	IntervalReader(const IntervalReader&) = delete;
+	IntervalReader& operator=(const IntervalReader&) = delete;
+
+	// False if the file could not be opened or mapped
+	inline bool is_open() const {
+		return mOpen;
+	}
+
+	inline int parts() const {
+		return (int) mParts.size();
+	}
+
+	/*
+	* Parse the lines of a part. Parts are independent, they may be parsed by different threads at
+	* once. Empty lines are skipped. Returns false if a line does not hold two decimal values.
+	*/
+	bool parse(int part);
+
+	/*
+	* Parse the next line of a part into `from` and `to`, skipping empty lines, for readers streaming
+	* the intervals instead of loading them with `parse`. A part is read either by `parse` or by
+	* `next`, by a single thread at a time.
+	* return : false at the end of the part or on a malformed line (see `ok`).
+	*/
+	bool next(int part, mpz_class* from, mpz_class* to);
+
+	/*
+	* True if the lines are sorted by lower bound. Bounds are compared as written, without parsing
+	* them, so the whole file is checked in about the time of a copy. May be called while the parts
+	* are being parsed.
+	*/
+	bool sorted() const;
+
+	// False once a malformed line was found in the part
+	inline bool ok(int part) const {
+		return mParts[part].ok;
+	}
+
+	/*
+	* Bounds of every line, in file order, once every part is parsed. The parts are moved out of the
+	* reader.
+	*
+	* return : vector of values [A, B, C, D, ...], NULL if a part failed. Property of caller.
+	*/
+	std::vector<mpz_class>* values();
+
+private:
+	/*
+	* A part of the file and its values.
+	* begin, end : bytes of the part not parsed yet, from the start of a line to the start of another
+	* one.
+	* values : bounds of the lines of the part, in order.
+	* digits : bound being parsed, NUL terminated for `mpz_set_str`.
+	* ok : false if a line of the part is malformed.
+	*/
+	struct part_values {
+		size_t begin;
+		size_t end;
+		std::vector<mpz_class> values;
+		std::string digits;
+		bool ok;
+	};
+
+	// Start of the first line beginning at or after `offset`
+	size_t line_start(size_t offset) const;
+
+	char* mData;	//! mapped file, NULL if not mapped
+	size_t mSize;	//! bytes of the file
+	bool mOpen;
+	std::vector<part_values> mParts;
+};
+
+#endif //! INTERVAL_READER_HPP
@@ -0,0 +1,218 @@
+#ifndef MILLER_RABIN_BATCH_HPP
+#define MILLER_RABIN_BATCH_HPP
+
+/*
+ * Lane parallel Miller-Rabin rounds: up to MR_BATCH_MAX_LANES odd candidates of the same size go
+ * through the same Montgomery exponentiation at once, one candidate per SIMD lane.
+ *
+ * Values are split in MR_BATCH_LIMB_BITS bits limbs, each stored in a 64 bits lane, so the 32x32
+ * bits lane multiplication (`vpmuludq`) can be accumulated several times before carries need to be
+ * propagated. Arrays are laid out limb major: `x[limb][lane]`.
+ *
+ * This header has no dependency on GMP so that the kernels can be compiled with different
+ * instruction sets (see miller-rabin-batch-avx2.cpp and miller-rabin-batch-avx512.cpp) without
+ * duplicating any inline function of the rest of the program.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MR_BATCH_MAX_LANES 8
+#define MR_BATCH_LIMB_BITS 26
+#define MR_BATCH_LIMB_MASK ((1ULL << MR_BATCH_LIMB_BITS) - 1)
+// Largest number of limbs of a batch (R = 2^(26 * limbs) must be greater than 4n), about 1000 bits
+#define MR_BATCH_MAX_LIMBS 40
+// Bits of the exponent handled per multiplication
+#define MR_BATCH_WINDOW_BITS 4
+#define MR_BATCH_MAX_WINDOWS ((MR_BATCH_MAX_LIMBS * MR_BATCH_LIMB_BITS + MR_BATCH_WINDOW_BITS - 1) / MR_BATCH_WINDOW_BITS)
+
+/*
+* One Miller-Rabin round for a batch of candidates, prepared by `prob_prime_batch`.
+* limbs : number of limbs of every value of the batch.
+* n : candidates (odd).
+* n_inv : -n^-1 mod 2^MR_BATCH_LIMB_BITS.
+* r2 : R^2 mod n, with R = 2^(MR_BATCH_LIMB_BITS * limbs).
+* one, minus_one : R mod n and n - (R mod n), that is 1 and -1 in Montgomery form.
+* a : witnesses, in [2, n - 2].
+* windows : exponent d (n - 1 = d * 2^s) split in windows of MR_BATCH_WINDOW_BITS bits, most
+* significant first.
+* nb_windows : number of windows of the largest exponent of the batch.
+* s : power of two of n - 1.
+* table : scratch space of the kernel, a^0 to a^15 in Montgomery form.
+*/
+struct mr_batch {
+	size_t limbs;
+	uint64_t n[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+	uint64_t n_inv[MR_BATCH_MAX_LANES];
+	uint64_t r2[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+	uint64_t one[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+	uint64_t minus_one[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+	uint64_t a[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+	uint8_t windows[MR_BATCH_MAX_WINDOWS][MR_BATCH_MAX_LANES];
+	size_t nb_windows;
+	unsigned s[MR_BATCH_MAX_LANES];
+	uint64_t table[1 << MR_BATCH_WINDOW_BITS][MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+};
+
+/*
+* Kernel running one round on the lanes [first_lane, first_lane + width) of the batch, width being
+* the number of lanes of the kernel vectors. `passed[lane]` is set to false if the witness proves
+* that the candidate is composite, true otherwise.
+*/
+typedef void (*mr_batch_kernel)(mr_batch* batch, size_t first_lane, bool* passed);
+
+void mr_batch_round_avx2(mr_batch* batch, size_t first_lane, bool* passed);
+void mr_batch_round_avx512(mr_batch* batch, size_t first_lane, bool* passed);
+
+/*
+* Kernel body, shared by every instruction set. `V` wraps the vector type and operations:
+* V::LANES, V::vec, load, store, set1, add, mul32 (low 32 bits of each lane multiplied into 64 bits),
+* and_, srli.
+*/
+template <class V>
+class MrBatchRound {
+public:
+	typedef typename V::vec vec;
+
+	MrBatchRound(mr_batch* batch, size_t first_lane)
+		: mBatch(batch)
+		, mLane(first_lane)
+		, mLimbs(batch->limbs)
+		, mMask(V::set1(MR_BATCH_LIMB_MASK))
+		, mNInv(V::load(&batch->n_inv[first_lane])) {
+		load(mN, batch->n);
+	}
+
+	void run(bool* passed) {
+		const size_t M = mLimbs;
+		vec a[MR_BATCH_MAX_LIMBS], x[MR_BATCH_MAX_LIMBS], y[MR_BATCH_MAX_LIMBS];
+
+		// Table of a^0 .. a^15 in Montgomery form
+		load(x, mBatch->r2);
+		load(y, mBatch->a);
+		mul(a, y, x);
+		load(x, mBatch->one);
+		store(mBatch->table[0], x);
+		store(mBatch->table[1], a);
+		for (size_t w = 2; w < (1u << MR_BATCH_WINDOW_BITS); w++) {
+			load(y, mBatch->table[w - 1]);
+			mul(y, y, a);
+			store(mBatch->table[w], y);
+		}
+
+		// x = a^d, fixed windows, each lane picking its own table entry
+		for (size_t k = 0; k < mBatch->nb_windows; k++) {
+			if (k > 0)
+				for (int b = 0; b < MR_BATCH_WINDOW_BITS; b++)
+					mul(x, x, x);
+			uint64_t sel[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+			for (size_t j = 0; j < M; j++)
+				for (size_t l = 0; l < V::LANES; l++)
+					sel[j][mLane + l] = mBatch->table[mBatch->windows[k][mLane + l]][j][mLane + l];
+			load(y, sel);
+			mul(x, x, y);
+		}
+
+		// x == 1 or x == -1 : passed. Then square up to s - 1 times looking for -1.
+		bool done[V::LANES];
+		unsigned max_s = 0;
+		for (size_t l = 0; l < V::LANES; l++) {
+			done[l]			  = false;
+			passed[mLane + l] = false;
+			if (mBatch->s[mLane + l] > max_s)
+				max_s = mBatch->s[mLane + l];
+		}
+		for (unsigned r = 0;; r++) {
+			uint64_t values[MR_BATCH_MAX_LIMBS][MR_BATCH_MAX_LANES];
+			store(values, x);
+			bool all_done = true;
+			for (size_t l = 0; l < V::LANES; l++) {
+				if (done[l])
+					continue;
+				size_t lane = mLane + l;
+				if (r >= mBatch->s[lane]) {
+					done[l] = true; // Definitely not a prime
+					continue;
+				}
+				canonical(values, lane);
+				if (equal(values, mBatch->minus_one, lane) || (r == 0 && equal(values, mBatch->one, lane))) {
+					done[l]		 = true;
+					passed[lane] = true;
+				} else if (r > 0 && equal(values, mBatch->one, lane)) {
+					done[l] = true; // Definitely not a prime
+				} else {
+					all_done = false;
+				}
+			}
+			if (all_done || r + 1 >= max_s)
+				break;
+			mul(x, x, x);
+		}
+	}
+
+private:
+	void load(vec* x, const uint64_t (*src)[MR_BATCH_MAX_LANES]) const {
+		for (size_t j = 0; j < mLimbs; j++)
+			x[j] = V::load(&src[j][mLane]);
+	}
+
+	void store(uint64_t (*dst)[MR_BATCH_MAX_LANES], const vec* x) const {
+		for (size_t j = 0; j < mLimbs; j++)
+			V::store(&dst[j][mLane], x[j]);
+	}
+
+	/*
+	* r = a * b / R mod n (almost: r < 2n for a, b < 2n). `r` may alias `a` or `b`.
+	* Operand scanning without carry propagation: each column accumulates 2 * limbs products of
+	* 52 bits at most, carries are only propagated once at the end.
+	*/
+	void mul(vec* r, const vec* a, const vec* b) const {
+		const size_t M = mLimbs;
+		vec t[2 * MR_BATCH_MAX_LIMBS + 1];
+		for (size_t j = 0; j <= 2 * M; j++)
+			t[j] = V::set1(0);
+		for (size_t i = 0; i < M; i++) {
+			for (size_t j = 0; j < M; j++)
+				t[i + j] = V::add(t[i + j], V::mul32(a[j], b[i]));
+			vec m = V::and_(V::mul32(V::and_(t[i], mMask), mNInv), mMask);
+			for (size_t j = 0; j < M; j++)
+				t[i + j] = V::add(t[i + j], V::mul32(m, mN[j]));
+			// t[i] is now a multiple of 2^MR_BATCH_LIMB_BITS
+			t[i + 1] = V::add(t[i + 1], V::srli(t[i], MR_BATCH_LIMB_BITS));
+		}
+		for (size_t j = M; j < 2 * M; j++) {
+			t[j + 1] = V::add(t[j + 1], V::srli(t[j], MR_BATCH_LIMB_BITS));
+			r[j - M] = V::and_(t[j], mMask);
+		}
+	}
+
+	// values[.][lane] = values[.][lane] mod n, for values < 2n
+	void canonical(uint64_t (*values)[MR_BATCH_MAX_LANES], size_t lane) const {
+		uint64_t diff[MR_BATCH_MAX_LIMBS];
+		int64_t borrow = 0;
+		for (size_t j = 0; j < mLimbs; j++) {
+			int64_t d = (int64_t) values[j][lane] - (int64_t) mBatch->n[j][lane] - borrow;
+			borrow	  = d < 0;
+			diff[j]	  = d & MR_BATCH_LIMB_MASK;
+		}
+		if (!borrow)
+			for (size_t j = 0; j < mLimbs; j++)
+				values[j][lane] = diff[j];
+	}
+
+	bool equal(const uint64_t (*a)[MR_BATCH_MAX_LANES], const uint64_t (*b)[MR_BATCH_MAX_LANES], size_t lane) const {
+		for (size_t j = 0; j < mLimbs; j++)
+			if (a[j][lane] != b[j][lane])
+				return false;
+		return true;
+	}
+
+	mr_batch* mBatch;
+	size_t mLane;
+	size_t mLimbs;
+	vec mMask;
+	vec mNInv;
+	vec mN[MR_BATCH_MAX_LIMBS];
+};
+
+#endif //! MILLER_RABIN_BATCH_HPP
@@ -8,12 +8,65 @@
  * Distributed under the modified BSD license.
  */
 
+#include <string>
 #include <gmpxx.h>
 #include <stdint.h>
 
-bool prob_prime(const mpz_class& n, const size_t rounds, gmp_randclass *rnd);
-extern "C" gmp_randclass * initialize_seed();
+/*
+* Tests run by `prob_prime` on values larger than 64 bits.
+* PRIME_TEST_MR_RANDOM : Miller-Rabin with `rounds` random witnesses.
+* PRIME_TEST_MR_FIXED : Miller-Rabin with the first `rounds` primes as witnesses.
+* PRIME_TEST_BPSW : Baillie-PSW, a base 2 Miller-Rabin round then a strong Lucas test, `rounds` is
+* ignored. Costs about 3 exponentiations, no composite passing it is known.
+*/
+enum prime_test {
+	PRIME_TEST_MR_RANDOM,
+	PRIME_TEST_MR_FIXED,
+	PRIME_TEST_BPSW
+};
+
+/*
+* Counter based random stream for the witnesses: value i of the stream is a mix of key + i * gamma
+* (SplitMix64), so drawing costs a few multiplications and needs no shared state. Each worker owns
+* its stream, a run is reproduced by giving the same seed.
+* key : stream key, derived from the seed and the stream number by `witness_rng_init`.
+* counter : number of values drawn.
+*/
+struct witness_rng {
+	uint64_t key;
+	uint64_t counter;
+};
+
+#define WITNESS_RNG_GAMMA 0x9E3779B97F4A7C15ULL
+
+// SplitMix64 finalizer, a bijection of the 64 bits values
+inline uint64_t witness_rng_mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+// Next 64 random bits of the stream
+inline uint64_t witness_rng_next(witness_rng* rng) {
+	return witness_rng_mix(rng->key + ++rng->counter * WITNESS_RNG_GAMMA);
+}
+
+void witness_rng_init(witness_rng* rng, uint64_t seed, uint64_t stream);
+
+void prob_prime_set_test(prime_test test);
+prime_test prob_prime_get_test();
+bool prime_test_parse(const std::string& name, prime_test* test);
+const char* prime_test_name(prime_test test);
+size_t prob_prime_mr_rounds(size_t rounds);
+bool prob_prime(const mpz_class& n, const size_t rounds, witness_rng* rng);
+bool prob_prime_from(const mpz_class& n, const size_t first, const size_t rounds, witness_rng* rng);
+bool prob_prime_u64(uint64_t n);
+void prob_prime_reserve(size_t bits);
+void prob_prime_batch(const mpz_class* candidates, size_t count, const size_t rounds, witness_rng* rng, bool* results);
+bool fits_u64(const mpz_class& n);
 mpz_class pow_mod(mpz_class a, mpz_class x, const mpz_class& n);
 mpz_class randint(const mpz_class& lowest, const mpz_class& highest, gmp_randclass * rnd);
+void draw_witness(const mpz_class& n, witness_rng* rng, mpz_class* a);
+void prob_prime_witness(const mpz_class& n, size_t round, witness_rng* rng, mpz_class* a);
 
 #endif //! MILLER_RABIN_GMP_H
\ No newline at end of file
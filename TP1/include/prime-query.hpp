@@ -0,0 +1,63 @@
+#ifndef PRIME_QUERY_HPP
+#define PRIME_QUERY_HPP
+
+/*
+ * Queries answered without building the list of every prime of the intervals: their number, the
+ * first of them, or the likely prime next to a value. The memory used does not grow with the
+ * intervals, and the first primes and the next prime are searched in ascending windows sized from
+ * the density of the primes (about 1 / ln(n) around n), so the work stops soon after the answer is
+ * found instead of at the end of the intervals.
+ */
+
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "cost-model.hpp"
+#include "sieve.hpp"
+#include "thread-pool.hpp"
+
+// Smallest number of values of a window of `first_primes`, `next_prime` and `prev_prime`
+#define QUERY_WINDOW_MIN 1024
+// A window covers QUERY_WINDOW_MARGIN times the values expected to hold the missing primes
+#define QUERY_WINDOW_MARGIN 1.5
+// Pieces of a window per worker, a piece being scanned by a single worker
+#define QUERY_PIECES_PER_WORKER 4
+// Smallest number of values of a piece, smaller ones do not pay for their sieve
+#define QUERY_PIECE_MIN 256
+
+/*
+* Count the likely primes of the `intervals`, each worker counting the primes of the pieces it takes
+* (see `StealScheduler`).
+* intervals : [lower_bound1, upper_bound1, ...], sorted and not overlapping (see
+* `merge_intervals`).
+* model : expected cost of the intervals, used to deal them to the workers. May be NULL.
+* stats : sieve counters, incremented.
+*
+* return : number of likely primes.
+*/
+uint64_t count_primes(ThreadPool * pool, const std::vector<mpz_class> * intervals, int rounds, const std::vector<uint32_t> * sieve_primes, const cost_model * model, sieve_stats * stats);
+
+/*
+* Call `on_prime(prime)` for the `k` smallest likely primes of the `intervals` (or all of them if
+* there are less), in ascending order.
+* intervals : same as `count_primes`.
+*
+* return : number of primes given to `on_prime`.
+*/
+uint64_t first_primes(ThreadPool * pool, const std::vector<mpz_class> * intervals, uint64_t k, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, const std::function<void(const mpz_class&)>& on_prime);
+
+/*
+* Find the smallest likely prime greater than `n` into `prime`, 2 if `n` < 2.
+*/
+void next_prime(ThreadPool * pool, const mpz_class& n, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, mpz_class * prime);
+
+/*
+* Find the greatest likely prime lower than `n` into `prime`.
+* return : false if there is none (`n` <= 2, 2 being the smallest prime).
+*/
+bool prev_prime(ThreadPool * pool, const mpz_class& n, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, mpz_class * prime);
+
+#endif //! PRIME_QUERY_HPP
@@ -0,0 +1,37 @@
+#ifndef PRIME_TEXT_HPP
+#define PRIME_TEXT_HPP
+
+/*
+ * Decimal output of a list of primes, threaded on the workers of a pool. The primes are cut into
+ * blocks converted by the workers into a text buffer of their own, each block being written with
+ * write(2) as a whole once the previous one is, so the conversion of the next blocks goes on while
+ * a block is written.
+ *
+ * Primes of a run only differ by their offsets, so only the first prime of a run in a block is
+ * converted by GMP; each following one is the decimal text of the previous one plus the gap of
+ * their offsets, added digit by digit from the end.
+ */
+
+#include <vector>
+
+#include <gmpxx.h>
+
+#include "prime-list.hpp"
+#include "thread-pool.hpp"
+
+// Number of primes converted at once by a worker, written with a single write(2)
+#define PRIME_TEXT_BLOCK 4096
+
+/*
+* Write the primes of `primes` in decimal to the file descriptor `fd`, each followed by a space, then
+* a new line.
+* intervals : if not NULL, the intervals [lower_bound1, upper_bound1, ...] holding the primes,
+* sorted and not overlapping (see `merge_intervals`). Each interval holding primes is then written
+* as "lower_bound: offset1 offset2 ..." on a line of its own, the offsets of its primes from its
+* lower bound being written instead of the primes, without converting any prime.
+*
+* return : false if the output can't be written.
+*/
+bool prime_text_write(ThreadPool * pool, const PrimeList * primes, const std::vector<mpz_class> * intervals, int fd);
+
+#endif //! PRIME_TEXT_HPP
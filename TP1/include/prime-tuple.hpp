@@ -0,0 +1,120 @@
+#ifndef PRIME_TUPLE_HPP
+#define PRIME_TUPLE_HPP
+
+/*
+ * Prime constellations: the values p for which every member a * p + b of a tuple is prime (twin
+ * primes p, p + 2, Sophie Germain primes p, 2p + 1, ...). The sieve strikes p out as soon as any
+ * member has a small prime factor, so far fewer values survive than with the sieve of the primes
+ * alone, and the members of a survivor are tested one at a time, the cheapest first, the others
+ * only if it is prime.
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "miller-rabin-gmp.hpp"
+#include "sieve.hpp"
+
+// Largest number of members of a tuple
+#define TUPLE_MAX_MEMBERS 2
+// Residue of `tuple_sieve::targets` for a member never divisible by the small prime
+#define TUPLE_NO_TARGET UINT32_MAX
+
+/*
+* A prime constellation.
+* name : name of the constellation on the command line.
+* members : number of members, at most TUPLE_MAX_MEMBERS.
+* a, b : coefficients of each member a * p + b, the cheapest member to test first.
+*/
+struct prime_tuple {
+	const char * name;
+	int members;
+	uint32_t a[TUPLE_MAX_MEMBERS];
+	uint32_t b[TUPLE_MAX_MEMBERS];
+};
+
+/*
+* Tables of the joint sieve of a constellation, computed once for every interval.
+* tuple : constellation sieved.
+* primes : small primes used to sieve.
+* targets : residue of p mod `primes[i]` for which the member `m` is a multiple of `primes[i]`, at
+* [i * TUPLE_MAX_MEMBERS + m]. TUPLE_NO_TARGET if the member is never a multiple of it, or if an
+* earlier member already strikes the same residue.
+*/
+struct tuple_sieve {
+	const prime_tuple * tuple;
+	std::vector<uint32_t> primes;
+	std::vector<uint32_t> targets;
+};
+
+const prime_tuple * prime_tuple_find(const std::string& name);
+tuple_sieve * tuple_sieve_new(const prime_tuple * tuple, const std::vector<uint32_t> * primes);
+void tuple_segment_fill(sieve_segment * seg, const mpz_class& base, const tuple_sieve * sieve, sieve_stats * stats);
+void tuple_segment_fill(sieve_segment * seg, uint64_t base, const tuple_sieve * sieve, sieve_stats * stats);
+
+/*
+* Find every p in [from, to) whose members are all likely primes and call `on_tuple(p)` for each of
+* them, in ascending order.
+* Tuples whose largest member fits in 64 bits are tested with the exact 64 bits test
+* (`prob_prime_u64`), without any GMP arithmetic per candidate.
+* rounds : number of miller-rabin rounds (unused for 64 bits members).
+* rng : random stream of the witnesses of miller-rabin.
+* sieve : joint sieve of the constellation (see `tuple_sieve_new`).
+* stats : sieve counters, the survivors being the tuples tested.
+*/
+template <typename F>
+void scan_tuples(const mpz_class& from, const mpz_class& to, size_t rounds, witness_rng * rng, const tuple_sieve * sieve, sieve_stats * stats, F on_tuple) {
+	const prime_tuple * tuple = sieve->tuple;
+	sieve_segment seg;
+	// Largest member of the interval, which gives the size of every member
+	mpz_class largest = 0;
+	for (int m = 0; m < tuple->members; m++) {
+		mpz_class member = (to - 1) * tuple->a[m] + tuple->b[m];
+		if (member > largest)
+			largest = member;
+	}
+	if (fits_u64(from) && fits_u64(largest)) {
+		uint64_t end = mpz_get_ui(to.get_mpz_t());
+		mpz_class found;
+		for (uint64_t base = mpz_get_ui(from.get_mpz_t()); base < end; base += seg.length) {
+			seg.length = end - base < SIEVE_SEGMENT_SIZE ? end - base : SIEVE_SEGMENT_SIZE;
+			tuple_segment_fill(&seg, base, sieve, stats);
+			for (uint64_t k = sieve_segment_next(&seg, 0); k < seg.length; k = sieve_segment_next(&seg, k + 1)) {
+				uint64_t p = base + k;
+				int m = 0;
+				while (m < tuple->members && prob_prime_u64(p * tuple->a[m] + tuple->b[m]))
+					m++;
+				if (m == tuple->members) {
+					mpz_set_ui(found.get_mpz_t(), p);
+					on_tuple(found);
+				}
+			}
+		}
+		return;
+	}
+	// Size the Miller-Rabin buffers once for the whole interval
+	prob_prime_reserve(mpz_sizeinbase(largest.get_mpz_t(), 2));
+	mpz_class p, member;
+	for (mpz_class base = from; base < to; base += seg.length) {
+		mpz_class remaining = to - base;
+		seg.length = mpz_cmp_ui(remaining.get_mpz_t(), SIEVE_SEGMENT_SIZE) < 0 ? remaining.get_ui() : SIEVE_SEGMENT_SIZE;
+		tuple_segment_fill(&seg, base, sieve, stats);
+		for (uint64_t k = sieve_segment_next(&seg, 0); k < seg.length; k = sieve_segment_next(&seg, k + 1)) {
+			mpz_add_ui(p.get_mpz_t(), base.get_mpz_t(), k);
+			int m = 0;
+			for (; m < tuple->members; m++) {
+				mpz_mul_ui(member.get_mpz_t(), p.get_mpz_t(), tuple->a[m]);
+				mpz_add_ui(member.get_mpz_t(), member.get_mpz_t(), tuple->b[m]);
+				if (!prob_prime(member, rounds, rng))
+					break;
+			}
+			if (m == tuple->members)
+				on_tuple(p);
+		}
+	}
+}
+
+#endif //! PRIME_TUPLE_HPP
@@ -0,0 +1,117 @@
+#ifndef QUERY_SERVER_HPP
+#define QUERY_SERVER_HPP
+
+/*
+ * Unix domain socket server of the prime queries, so that a client asking for the primes of a few
+ * intervals does not pay for the process startup, the thread creation and the small primes table
+ * of a run of its own. Batches are served one at a time, each one using every worker, the clients
+ * with a complete batch taking turns.
+ *
+ * Protocol, in text, a connection carrying any number of batches:
+ * - request : the intervals of the batch as in an input file ("A B" per line), then an empty line;
+ * - reply : the likely primes of the batch in ascending order, each followed by a space, then a new
+ *   line. Or "error: <reason>" then a new line.
+ * A client with more than QUERY_PENDING_MAX bytes received and not served yet gets
+ * "error: batch too large" and is dropped.
+ *
+ * Sockets are not blocking: a reply is queued and sent as the client reads it, the server going on
+ * with the batches of the other clients meanwhile. The next batch of a client is only taken once
+ * its last reply is sent, and a client leaving more than QUERY_UNSENT_MAX bytes of a reply unread
+ * is dropped.
+ */
+
+#include <string>
+#include <vector>
+
+#include <gmpxx.h>
+
+#include "prime-list.hpp"
+
+// Bytes read from or written to a client at once
+#define QUERY_BUFFER (1 << 16)
+// Bytes a client may send ahead of the batches taken, a client sending more is dropped
+#define QUERY_PENDING_MAX (64 * QUERY_BUFFER)
+// Bytes of a reply a client may leave unread, a client reading less is dropped
+#define QUERY_UNSENT_MAX (256 * QUERY_BUFFER)
+// Milliseconds between two checks of a stop request while waiting for a client
+#define QUERY_POLL_MS 100
+
+class QueryServer {
+public:
+	/*
+	* Listen on the socket `path`, replacing a socket left by a previous server. SIGINT and SIGTERM
+	* stop the server (see `next`).
+	*/
+	QueryServer(const std::string& path);
+
+	/*
+	* Close the connections and remove the socket.
+	*/
+	~QueryServer();
+
+	QueryServer(const QueryServer&) = delete;
+	QueryServer& operator=(const QueryServer&) = delete;
+
+	// False if the socket can't be created
+	inline bool is_open() const {
+		return mListen >= 0;
+	}
+
+	/*
+	* Wait for the next batch of any client, the clients taking turns.
+	* intervals : [lower_bound1, upper_bound1, ...] of the batch, as sent. Empty if the batch is
+	* malformed (see `malformed`).
+	*
+	* return : false once the server is stopped by a signal.
+	*/
+	bool next(std::vector<mpz_class>* intervals);
+
+	// True if the last batch is not a list of pairs of integers
+	inline bool malformed() const {
+		return mMalformed;
+	}
+
+	/*
+	* Send the primes of the last batch to its client, as they are converted to decimal. A client
+	* which is gone or does not read its reply is dropped.
+	*/
+	void reply(const PrimeList* primes);
+
+	/*
+	* Send an error to the client of the last batch.
+	*/
+	void reply_error(const std::string& reason);
+
+private:
+	/*
+	* Connection of a client.
+	* fd : socket, -1 once the client is gone.
+	* pending : bytes received and not part of a batch yet.
+	* closed : true once the client sent its last request.
+	* output : bytes of the replies queued for the client, sent from `written`.
+	*/
+	struct query_client {
+		int fd;
+		std::string pending;
+		bool closed;
+		std::string output;
+		size_t written;
+	};
+
+	bool take_batch(std::string* batch);
+	void wait(int timeout);
+	void receive(query_client* client);
+	void flush(query_client* client);
+	void drop(query_client* client);
+	bool parse(const std::string& batch, std::vector<mpz_class>* intervals);
+	void send(const char* data, size_t size);
+
+	std::string mPath;
+	int mListen;
+	std::vector<query_client> mClients;
+	size_t mCurrent;		   //! client of the last batch
+	std::vector<char> mBuffer;
+	bool mMalformed;
+};
+
+#endif //! QUERY_SERVER_HPP
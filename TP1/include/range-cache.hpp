@@ -0,0 +1,115 @@
+#ifndef RANGE_CACHE_HPP
+#define RANGE_CACHE_HPP
+
+/*
+ * On-disk cache of the ranges already scanned, so that a range asked again (by the same run, or by
+ * later runs) is not scanned twice. A cache is a directory holding:
+ * - `index`, a line per scanned range : <test> <rounds> <from> <to> <file>
+ * - the primes of each range, in the binary format of prime-file.hpp, in <file>.
+ *
+ * A range scanned by the same test with at least as many Miller-Rabin rounds is reused. The
+ * intervals of a run are split into the parts covered by the cache and the gaps, only the gaps are
+ * scanned, then the primes of both are spliced back in order and the gaps are added to the cache.
+ * Entries are written before their index line, an interrupted run leaves no entry without primes.
+ * The cache is not locked, runs sharing a cache must not run at the same time.
+ */
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmpxx.h>
+
+#include "miller-rabin-gmp.hpp"
+#include "prime-file.hpp"
+#include "prime-list.hpp"
+
+// Name of the index file in the cache directory
+#define RANGE_CACHE_INDEX "index"
+
+class RangeCache {
+public:
+	/*
+	* Open the cache in the directory `dir`, created if it does not exist, for the results of `test`
+	* with `rounds` rounds.
+	*/
+	RangeCache(const std::string& dir, prime_test test, size_t rounds);
+
+	RangeCache(const RangeCache&) = delete;
+	RangeCache& operator=(const RangeCache&) = delete;
+
+	// False if the directory can't be created or its index can't be read
+	inline bool is_open() const {
+		return mOpen;
+	}
+
+	/*
+	* Split the intervals into parts found in the cache and gaps, the split is kept for `splice`.
+	* intervals : [lower_bound1, upper_bound1, ...], sorted and not overlapping (see
+	* `merge_intervals`).
+	*
+	* return : the gaps, same layout as `intervals`. Property of caller.
+	*/
+	std::vector<mpz_class>* gaps(const std::vector<mpz_class>* intervals);
+
+	/*
+	* Splice the primes of the cached parts and the primes found in the gaps given by the last call
+	* to `gaps`, and store the gaps in the cache.
+	* computed : primes found in the gaps, in ascending order.
+	*
+	* return : primes of the intervals, in ascending order. NULL if an entry of the cache can't be
+	* read. Property of caller.
+	*/
+	PrimeList* splice(const PrimeList* computed);
+
+	// Number of values taken from the cache and scanned by the last call to `gaps`
+	inline const mpz_class& cached() const {
+		return mCached;
+	}
+	inline const mpz_class& scanned() const {
+		return mScanned;
+	}
+
+private:
+	/*
+	* A scanned range [from, to) and the file of its primes.
+	*/
+	struct cache_entry {
+		mpz_class from;
+		mpz_class to;
+		std::string file;
+	};
+
+	/*
+	* A part [from, to) of the intervals, taken from the cache entry `entry`, or a gap to scan if
+	* `entry` is negative.
+	*/
+	struct cache_segment {
+		mpz_class from;
+		mpz_class to;
+		long entry;
+	};
+
+	void splice_gap(const cache_segment& gap, PrimeList::iterator& prime, const PrimeList::iterator& end, PrimeList* output);
+	bool splice_entry(const cache_segment& part, PrimeList* output);
+
+	std::string mDir;
+	std::string mTest;
+	size_t mRounds;
+	bool mOpen;
+	std::vector<cache_entry> mEntries;	 //! usable entries, sorted by lower bound
+	std::vector<cache_segment> mSegments; //! split of the intervals of the last `gaps`
+	size_t mNextFile;					 //! number tried first for the file of a new entry
+	mpz_class mCached;
+	mpz_class mScanned;
+	// Entry read by the last `splice_entry`, kept open so that its next parts are read from where the
+	// previous one stopped instead of from the start of the file
+	long mReadEntry;					 //! index in mEntries, negative if no entry is open
+	std::ifstream mReadFile;
+	std::unique_ptr<PrimeReader> mReader;
+	mpz_class mReadPrime;				 //! prime read past the previous part, if mReadPending
+	bool mReadPending;
+};
+
+#endif //! RANGE_CACHE_HPP
@@ -0,0 +1,114 @@
+#ifndef STEAL_SCHEDULER_HPP
+#define STEAL_SCHEDULER_HPP
+
+/*
+ * Work stealing scheduler over splittable ranges of values. Every interval is cut into slices of at
+ * most 2^64 values, ranges of a slice are described by 64 bits offsets from the slice base so no
+ * big number is touched to split or hand out work. Each worker consumes its own ranges piece by
+ * piece; a worker without work steals the oldest range of another worker, or the upper half of its
+ * last range.
+ */
+
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "cost-model.hpp"
+
+// Default number of values handed out at once to a worker. Each piece is sieved on its own, smaller
+// pieces than a sieve segment (SIEVE_SEGMENT_SIZE) pay the sieve setup several times per segment.
+#define STEAL_DEFAULT_GRAIN 32768
+
+/*
+* A range of values to test.
+* slice : slice holding the range (see `StealScheduler::base`).
+* begin, end : offsets from the base of the slice, the range is [begin, end).
+*/
+struct steal_range {
+	size_t slice;
+	uint64_t begin;
+	uint64_t end;
+};
+
+/*
+* Scheduling counters of a worker.
+* pieces : number of pieces processed.
+* steals : number of ranges stolen from other workers.
+*/
+struct steal_stats {
+	uint64_t pieces;
+	uint64_t steals;
+};
+
+class StealScheduler {
+public:
+	/*
+	* nb_workers : number of workers calling `next`, identified by [0, nb_workers).
+	* grain : largest number of values of a piece returned by `next`.
+	*/
+	StealScheduler(int nb_workers, uint64_t grain = STEAL_DEFAULT_GRAIN);
+	~StealScheduler();
+
+	StealScheduler(const StealScheduler&) = delete;
+	StealScheduler& operator=(const StealScheduler&) = delete;
+
+	/*
+	* Add the interval [from, to) to the work, numbered after the intervals already added. Slices are
+	* dealt round robin to the workers. Must not be called once the workers started.
+	*/
+	void add_interval(const mpz_class& from, const mpz_class& to);
+
+	/*
+	* Deal the ranges again by expected cost, longest expected first (LPT): ranges expected to take
+	* more than 1 / (2 * nb_workers) of the total are split, then each range, from the most to the
+	* least expensive, goes to the least loaded worker. Each worker starts with its most expensive
+	* range, thieves take the cheapest ones. Must not be called once the workers started.
+	*/
+	void plan(const cost_model* model);
+
+	/*
+	* Take the next piece of work of `worker`, stealing from other workers if it has none left.
+	* return : false when there is no work left for this worker.
+	*/
+	bool next(int worker, steal_range* piece);
+
+	// Lower bound and interval number of a slice
+	inline const mpz_class& base(size_t slice) const {
+		return mBases[slice];
+	}
+	inline size_t interval(size_t slice) const {
+		return mSliceIntervals[slice];
+	}
+	// Lower bound of every slice, by slice number
+	inline const std::vector<mpz_class>& bases() const {
+		return mBases;
+	}
+
+	inline const steal_stats& stats(int worker) const {
+		return mDeques[worker].stats;
+	}
+
+private:
+	bool steal(int worker);
+
+	/*
+	* Ranges owned by a worker. The owner works on the back, thieves take from the front. Aligned on
+	* a cache line so that workers don't share lines.
+	*/
+	struct alignas(64) worker_deque {
+		pthread_mutex_t mutex;
+		std::deque<steal_range> ranges;
+		steal_stats stats;
+	};
+
+	std::vector<mpz_class> mBases;		   //! first value of each slice (part of an interval)
+	std::vector<size_t> mSliceIntervals; //! number of the interval each slice comes from
+	std::vector<worker_deque> mDeques;
+	uint64_t mGrain;
+	size_t mIntervals;
+};
+
+#endif //! STEAL_SCHEDULER_HPP
@@ -0,0 +1,72 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+/*
+ * Persistent pool of pthread workers. Threads and their per-worker state are created once and
+ * reused by every job (every interval, every input file), instead of one pthread_create/join per
+ * interval.
+ */
+
+#include <functional>
+#include <vector>
+
+#include <pthread.h>
+#include <gmpxx.h>
+
+#include "miller-rabin-gmp.hpp"
+
+/*
+* State of a pool worker, created once and kept across jobs.
+* index : worker number, in [0, size of the pool).
+* rng : random stream of the worker for the miller-rabin witnesses, stream `index` of the seed.
+* from, to : scratch values for the bounds of the range being processed.
+*/
+struct pool_worker {
+	int index;
+	witness_rng rng;
+	mpz_class from;
+	mpz_class to;
+};
+
+class ThreadPool {
+public:
+	/*
+	* Start `nb_threads` workers, waiting for jobs.
+	* seed : seed of the random streams of the workers.
+	*/
+	ThreadPool(int nb_threads, uint64_t seed);
+
+	/*
+	* Stop and join every worker.
+	*/
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	inline int size() const {
+		return (int) mWorkers.size();
+	}
+
+	/*
+	* Run `job(worker)` on every worker of the pool at once and wait for all of them to return.
+	* Jobs share their work themselves (see `compute_prime_1` and `compute_prime_2`), the pool only
+	* wakes the workers up. Must not be called from a job.
+	*/
+	void run(const std::function<void(pool_worker *)>& job);
+
+private:
+	static void * loop(void * data);
+
+	std::vector<pool_worker> mWorkers;
+	std::vector<pthread_t> mThreads;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mWake;	  //! signaled when a job is posted or the pool is stopping
+	pthread_cond_t mDone;	  //! signaled when the last worker finished the job
+	const std::function<void(pool_worker *)> * mJob;
+	unsigned long mGeneration; //! number of jobs posted, workers wait for it to change
+	int mPending;			   //! number of workers still running the current job
+	bool mStop;
+};
+
+#endif //! THREAD_POOL_HPP
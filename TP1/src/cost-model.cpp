@@ -0,0 +1,112 @@
+/*
+ * Cost model of the interval scan, see cost-model.hpp.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Chrono.hpp"
+#include "cost-model.hpp"
+#include "scan.hpp"
+
+// Number of values scanned per calibration sample
+#define COST_CALIBRATION_LENGTH 4096
+// Number of times the sieve of a sample is timed, the fastest is kept
+#define COST_CALIBRATION_REPEAT 3
+// Smallest cost used for interpolation, measured costs can be null at low resolution
+#define COST_EPSILON 1e-12
+
+/*
+* Time the sieve and the scan of COST_CALIBRATION_LENGTH values from 2^(bits - 1).
+*/
+static cost_sample cost_measure(size_t bits, size_t rounds, const std::vector<uint32_t>* sieve_primes, witness_rng* rng) {
+	mpz_class from = 0;
+	mpz_setbit(from.get_mpz_t(), bits - 1);
+	mpz_class to = from + COST_CALIBRATION_LENGTH;
+	sieve_stats stats{};
+
+	// Sieve alone
+	sieve_segment seg;
+	seg.length = COST_CALIBRATION_LENGTH;
+	double segment = INFINITY;
+	for (int i = 0; i < COST_CALIBRATION_REPEAT; i++) {
+		Chrono c(true);
+		if (fits_u64(to))
+			sieve_segment_fill(&seg, mpz_get_ui(from.get_mpz_t()), sieve_primes, &stats);
+		else
+			sieve_segment_fill(&seg, from, sieve_primes, &stats);
+		c.pause();
+		segment = std::min(segment, c.get());
+	}
+
+	// Sieve and test
+	size_t found = 0;
+	Chrono c(true);
+	scan_interval(from, to, rounds, rng, sieve_primes, &stats, [&](const mpz_class&) {
+		found++;
+	});
+	c.pause();
+	double value = (c.get() - segment) / COST_CALIBRATION_LENGTH;
+	return {bits, segment, value > 0 ? value : 0};
+}
+
+/*
+* Measure the scan cost at a few bit sizes, with the rounds and sieve of the actual run.
+* rounds : number of miller-rabin rounds.
+* sieve_primes : small primes used to sieve the intervals.
+*
+* result pointer is property of caller
+*/
+cost_model* cost_model_calibrate(size_t rounds, const std::vector<uint32_t>* sieve_primes) {
+	cost_model* model = new cost_model();
+	// Fixed stream, the measures do not depend on the witnesses
+	witness_rng rng;
+	witness_rng_init(&rng, 0, 0);
+	for (size_t bits : {32, 64})
+		model->small.push_back(cost_measure(bits, rounds, sieve_primes, &rng));
+	for (size_t bits : {128, 256, 512, 1024})
+		model->large.push_back(cost_measure(bits, rounds, sieve_primes, &rng));
+	return model; // Property of caller
+}
+
+/*
+* Power law interpolation of `field` between the samples around `bits`, extrapolated from the two
+* nearest samples out of their range.
+*/
+static double cost_interpolate(const std::vector<cost_sample>& samples, size_t bits, double cost_sample::*field) {
+	if (samples.size() == 1 || bits <= samples.front().bits)
+		return samples.front().*field;
+	size_t i = 1;
+	while (i + 1 < samples.size() && samples[i].bits < bits)
+		i++;
+	const cost_sample& lo = samples[i - 1];
+	const cost_sample& hi = samples[i];
+	double y0 = std::max(lo.*field, COST_EPSILON);
+	double y1 = std::max(hi.*field, COST_EPSILON);
+	double exponent = std::log(y1 / y0) / std::log((double) hi.bits / lo.bits);
+	return y0 * std::pow((double) bits / lo.bits, exponent);
+}
+
+/*
+* Expected seconds to scan [from, to) (see `scan_interval`).
+*/
+double cost_model_estimate(const cost_model* model, const mpz_class& from, const mpz_class& to) {
+	if (to <= from)
+		return 0;
+	const std::vector<cost_sample>& samples = fits_u64(to) ? model->small : model->large;
+	size_t bits = mpz_sizeinbase(to.get_mpz_t(), 2);
+	mpz_class length_z = to - from;
+	double length = length_z.get_d();
+	double segments = std::ceil(length / SIEVE_SEGMENT_SIZE);
+	return segments * cost_interpolate(samples, bits, &cost_sample::segment) + length * cost_interpolate(samples, bits, &cost_sample::value);
+}
+
+/*
+* Print the calibration samples on the error output.
+*/
+void cost_model_print(const cost_model* model) {
+	for (const std::vector<cost_sample>* samples : {&model->small, &model->large})
+		for (const cost_sample& s : *samples)
+			std::cerr << "cost: " << s.bits << " bits, " << s.segment * 1e6 << " us per segment, " << s.value * 1e9 << " ns per value" << std::endl;
+}
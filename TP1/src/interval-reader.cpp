@@ -0,0 +1,185 @@
+/*
+ * Parallel reader of interval files, see interval-reader.hpp.
+ */
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interval-reader.hpp"
+
+IntervalReader::IntervalReader(const std::string& path, int nb_parts)
+	: mData(NULL)
+	, mSize(0)
+	, mOpen(false)
+	, mParts(nb_parts > 0 ? nb_parts : 1) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		mOpen = true;
+		mSize = st.st_size;
+	}
+	if (mSize > 0) {
+		void* data = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			mData = (char*) data;
+			madvise(mData, mSize, MADV_SEQUENTIAL);
+		} else {
+			mOpen = false;
+			mSize = 0;
+		}
+	}
+	close(fd);
+
+	for (size_t i = 0; i < mParts.size(); i++) {
+		mParts[i].begin = line_start(mSize * i / mParts.size());
+		mParts[i].end = line_start(mSize * (i + 1) / mParts.size());
+		mParts[i].ok = true;
+	}
+}
+
+IntervalReader::~IntervalReader() {
+	if (mData != NULL)
+		munmap(mData, mSize);
+}
+
+size_t IntervalReader::line_start(size_t offset) const {
+	if (offset == 0)
+		return 0;
+	// The line holding the byte before `offset` belongs to the previous part
+	while (offset < mSize && mData[offset - 1] != '\n')
+		offset++;
+	return offset;
+}
+
+static inline bool is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+* Compare two decimal values as written (optional '-', then digits), without parsing them.
+* return : negative, zero or positive as a is lower, equal or greater than b.
+*/
+static int compare_decimal(const char* a, size_t a_size, const char* b, size_t b_size) {
+	int a_sign = 1, b_sign = 1;
+	if (a_size > 0 && a[0] == '-') {
+		a_sign = -1;
+		a++, a_size--;
+	}
+	if (b_size > 0 && b[0] == '-') {
+		b_sign = -1;
+		b++, b_size--;
+	}
+	while (a_size > 0 && a[0] == '0')
+		a++, a_size--;
+	while (b_size > 0 && b[0] == '0')
+		b++, b_size--;
+	if (a_size == 0)
+		a_sign = 0;
+	if (b_size == 0)
+		b_sign = 0;
+	if (a_sign != b_sign)
+		return a_sign - b_sign;
+	// Same sign, compare the magnitudes
+	int cmp = a_size != b_size ? (a_size < b_size ? -1 : 1) : memcmp(a, b, a_size);
+	return a_sign * cmp;
+}
+
+bool IntervalReader::sorted() const {
+	const char* previous = NULL;
+	size_t previous_size = 0;
+	size_t pos = 0;
+	while (pos < mSize) {
+		while (pos < mSize && (is_blank(mData[pos]) || mData[pos] == '\n'))
+			pos++;
+		size_t token = pos;
+		while (pos < mSize && !is_blank(mData[pos]) && mData[pos] != '\n')
+			pos++;
+		if (pos > token) {
+			if (previous != NULL && compare_decimal(previous, previous_size, mData + token, pos - token) > 0)
+				return false;
+			previous = mData + token;
+			previous_size = pos - token;
+		}
+		// Skip the upper bound
+		while (pos < mSize && mData[pos] != '\n')
+			pos++;
+	}
+	return true;
+}
+
+bool IntervalReader::next(int part, mpz_class* from, mpz_class* to) {
+	part_values& p = mParts[part];
+	mpz_class* bounds[2] = {from, to};
+	while (p.ok && p.begin < p.end) {
+		size_t pos = p.begin;
+		size_t line_end = pos;
+		while (line_end < p.end && mData[line_end] != '\n')
+			line_end++;
+		p.begin = line_end + 1;
+		// Two bounds separated by blanks, anything else is an error
+		int found = 0;
+		while (pos < line_end) {
+			while (pos < line_end && is_blank(mData[pos]))
+				pos++;
+			if (pos == line_end)
+				break;
+			size_t token = pos;
+			while (pos < line_end && !is_blank(mData[pos]))
+				pos++;
+			if (found == 2) {
+				p.ok = false;
+				return false;
+			}
+			p.digits.assign(mData + token, pos - token);
+			if (mpz_set_str(bounds[found]->get_mpz_t(), p.digits.c_str(), 10) != 0) {
+				p.ok = false;
+				return false;
+			}
+			found++;
+		}
+		if (found == 2)
+			return true;
+		// Empty lines are skipped
+		if (found == 1)
+			p.ok = false;
+	}
+	return false;
+}
+
+bool IntervalReader::parse(int part) {
+	std::vector<mpz_class>& values = mParts[part].values;
+	// Bounds are parsed in place at the end of the values
+	for (;;) {
+		values.emplace_back();
+		values.emplace_back();
+		size_t n = values.size();
+		if (!next(part, &values[n - 2], &values[n - 1])) {
+			values.resize(n - 2);
+			break;
+		}
+	}
+	return mParts[part].ok;
+}
+
+std::vector<mpz_class>* IntervalReader::values() {
+	size_t size = 0;
+	for (const part_values& part : mParts) {
+		if (!part.ok)
+			return NULL;
+		size += part.values.size();
+	}
+	std::vector<mpz_class>* values = new std::vector<mpz_class>();
+	values->reserve(size);
+	for (part_values& part : mParts) {
+		for (mpz_class& value : part.values)
+			values->push_back(std::move(value));
+		std::vector<mpz_class>().swap(part.values);
+	}
+	return values; // Property of caller
+}
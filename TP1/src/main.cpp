@@ -4,350 +4,1023 @@
  * \author Vincent Commin & Louis Leenart
  */
 
+#include <atomic>
+#include <ctime>
+#include <functional>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <pthread.h>
+#include <unistd.h>
 #include <gmpxx.h>
 
 #include "Chrono.hpp"
+#include "alloc-counter.hpp"
+#include "checkpoint.hpp"
+#include "cost-model.hpp"
+#include "interval-reader.hpp"
 #include "miller-rabin-gmp.hpp"
+#include "pipeline.hpp"
+#include "prime-file.hpp"
+#include "prime-list.hpp"
+#include "prime-query.hpp"
+#include "prime-text.hpp"
+#include "prime-tuple.hpp"
+#include "query-server.hpp"
+#include "range-cache.hpp"
+#include "result-buffer.hpp"
+#include "scan.hpp"
+#include "steal-scheduler.hpp"
+#include "thread-pool.hpp"
+
+// Smallest number of values claimed at once by a `compute_prime_1_worker`
+#define CLAIM_MIN_CHUNK 1024
+// A claim takes 1 / (CLAIM_GUIDED_FACTOR * nb_threads) of the values left in the interval
+#define CLAIM_GUIDED_FACTOR 2
+// Largest number of values claimed at once, primes of a chunk are stored as 32 bits offsets
+#define CLAIM_MAX_CHUNK UINT32_MAX
+// Expected cost (seconds) of a file below which waking the workers and merging their results costs
+// more than it saves, `STRATEGY_AUTO` then scans it unthreaded
+#define STRATEGY_UNTHREADED_COST 1e-3
+// Bit size the scratch values of the tests of every worker are allocated for when a server starts
+#define SERVE_WARM_BITS 1024
+
+/*
+* Work distribution counters of a `compute_prime_1_worker`.
+* chunks : number of chunks claimed.
+* contention : number of claims which failed because another worker claimed a chunk at the same time.
+*/
+struct claim_stats {
+	uint64_t chunks;
+	uint64_t contention;
+};
+
+/*
+* Parallelization of the batch computation, see `compute_prime`.
+*/
+enum compute_strategy {
+	STRATEGY_AUTO,		 // picked for each interval by `strategy_plan`
+	STRATEGY_UNTHREADED, // `compute_prime_unthreaded`
+	STRATEGY_NUMBER,	 // `compute_prime_1`, every worker claims values of each interval in turn
+	STRATEGY_INTERVAL,	 // `compute_prime_2`, intervals dealt to the workers, split and stolen
+	STRATEGY_COUNT
+};
+
+static const char* compute_strategy_names[STRATEGY_COUNT] = {"auto", "unthreaded", "number", "interval"};
+
+/*
+* Answer printed instead of every prime of the intervals, see prime-query.hpp.
+*/
+enum query_mode {
+	QUERY_NONE,
+	QUERY_COUNT, // number of primes of the intervals
+	QUERY_FIRST, // first primes of the intervals
+	QUERY_NEXT,	 // smallest prime greater than a value
+	QUERY_PREV,	 // greatest prime lower than a value
+};
+
+/*
+* Strategy counters of `compute_prime`.
+* intervals : number of intervals scanned with each strategy, indexed by `compute_strategy`.
+*/
+struct strategy_stats {
+	uint64_t intervals[STRATEGY_COUNT];
+};
 
 /* 
-* Data shared from `compute_prime_1` to each `compute_prime_1_worker` thread.
-* primes : return vector of values. Each thread add their found primes (with mutex `mutex_primes`).
-* rnd : random number generator needed by miller rabin algorithm. Share amoung threads, prevents
-* from re-allocating it each time. Thread safe (see GMP documentation). Initialised from
-* `initialize_seed()`.
+* Data shared from `compute_prime_1` to each `compute_prime_1_worker` call.
+* results : result buffers, one per worker. Each worker adds a run of primes per chunk to its own
+* buffer, keyed by `slice` and the offset of the chunk.
+* slice : number of the interval slice being processed, in ascending order of the values.
 * rounds : number of rounds of miller-rabin algorithm to do. The higher the more accurate the result
 * is, but the more expensive (time) it is.
-* count : status of the computation. When a thread is free, it can read `count` as the next "target"
-* to check if the number is prime or not, and increment it. The next thread will do the same until 
-* `count` >= `max`. `count` initial value is the lower bound of the interval. `count` reads & writes
-* requires the possession of the mutex `mutex_count`.
-* max : upper bound of the interval. Read only (no mutex).
+* base : lower bound of the interval. Read only.
+* length : number of values in the interval (from `base`). Read only.
+* next : offset from `base` of the first value not claimed yet. When a worker is free, it claims the
+* chunk [next, next + chunk) by moving `next` forward with a compare and swap, chunks getting smaller
+* as the interval is consumed (guided scheduling), until `next` >= `length`.
+* nb_threads : number of workers, used to size the chunks.
+* sieve_primes : small primes used to sieve each chunk before running miller-rabin. Read only.
+* stats : sieve counters, each worker adds its own counters when it is done (with `mutex_stats`).
+* claims : work distribution counters, one per worker, each worker adds its own. May be NULL.
 */
 struct thread_data_1 {
-	std::vector<mpz_class> * primes;
-	gmp_randclass *rnd;
+	std::vector<result_buffer> * results;
+	size_t slice;
   	int rounds;
-  	mpz_class count;
-  	mpz_class max;
+	mpz_class base;
+	uint64_t length;
+	std::atomic<uint64_t> next;
+	int nb_threads;
+	const std::vector<uint32_t> * sieve_primes;
+	sieve_stats stats;
+	claim_stats * claims;
 };
 
-
 /*
-* Data shared from `compute_prime_2` to each `compute_prime_2_worker` thread.
-* intervals : array of intervals. Shared amoung every worker. When a thread is free, it read the
-* next 2 values from `index` (as lower and upper bounds of an interval) and can compute primes from
-* them. 
-* primes : return vector of values. Shared amoung every worker, it need to be accessed (read &
-* write) with a mutex (`mutex_primes`). When the stack of job is empty, before stopping the worker
-* will take the mutex and write his found primes into `primes`. Initialised as empty.
+* Data shared from `compute_prime_2` to each `compute_prime_2_worker` call.
+* scheduler : work stealing scheduler handing out pieces of the intervals to the workers.
+* results : result buffers, one per worker. Each worker adds a run of primes per piece to its own
+* buffer, without any lock.
 * rounds : number of rounds of miller-rabin algorithm to do. The higher the more accurate the result
 * is, but the more expensive (time) it is.
-* index : index of the next available interval. Initialised at 0, worker need the mutex
-* `mutex_index` to read OR write. `-1` value means not more intervals.
+* sieve_primes : small primes used to sieve each interval before running miller-rabin. Read only.
+* tuples : joint sieve of the constellation searched instead of the primes, NULL for the primes.
+* stats : sieve counters, each worker adds its own counters when it is done (with `mutex_stats`).
 */
 struct thread_data_2 {
-	std::vector<mpz_class> * intervals;
-	std::vector<mpz_class> * primes;
+	StealScheduler * scheduler;
+	std::vector<result_buffer> * results;
 	int rounds;
-	int index;
+	const std::vector<uint32_t> * sieve_primes;
+	const tuple_sieve * tuples;
+	sieve_stats stats;
 };
 
-// To read/write thread_data_1.primes or thread_data_2.primes
-pthread_mutex_t mutex_primes;
-// To read/write thread_data_1.count
-pthread_mutex_t mutex_count;
-// To read/write thread_data_1.intervals
-pthread_mutex_t mutex_intervals;
-// To read/write thread_data_2.index
-pthread_mutex_t mutex_index;
+// To read/write thread_data_1.stats or thread_data_2.stats
+pthread_mutex_t mutex_stats = PTHREAD_MUTEX_INITIALIZER;
 
 /*
-* Thread function to find every primes between two mpz_class values.
-* data : `thread_data_1` pointer
-* Process thread_data_1.count to thread_data_1.max values, push each potential prime value into
-* thread_data_1.prime until there is no more values to test. 
-* Requires mutex_primes & mutex_count initialised.
+* Pool job to find every primes between two mpz_class values.
+* worker : pool worker running the job.
+* td : data shared with the other workers.
+* Claim chunks of thread_data_1.base + [0, thread_data_1.length) until there is no more values to
+* test, push each potential prime value into the result buffer of the worker.
 */
-void * compute_prime_1_worker(void * data) {
-	// Retrieve data provided from master
-  	struct thread_data_1 * td = (struct thread_data_1 *)data;
-	std::vector<mpz_class> worker_primes{};
+void compute_prime_1_worker(pool_worker * worker, thread_data_1 * td) {
+	result_buffer * buffer = &td->results->at(worker->index);
+	sieve_stats worker_stats{};
+	claim_stats worker_claims{};
+	uint64_t start = td->next.load(std::memory_order_relaxed);
 	// While there is numbers to test
 	for (;;) {
-		// Check if the remaining interval needs processing
-		pthread_mutex_lock(&mutex_count);
-		if (td->count >= td->max) {pthread_mutex_unlock(&mutex_count); break;} // no more values to test, closing thread.
-		mpz_class target = td->count;
-		td->count++;
-		pthread_mutex_unlock(&mutex_count);
-		// Run the Miller-Rabin algorithm  
-		bool res = prob_prime(target, td->rounds, td->rnd);
-
-		// if the number is (likely) prime, write it in the local vector
-		if (res) {
-			worker_primes.push_back(target);
+		// Claim the next chunk, the shared offset is only touched once per chunk
+		if (start >= td->length)
+			break; // no more values to test, closing thread.
+		uint64_t remaining = td->length - start;
+		uint64_t chunk = remaining / (CLAIM_GUIDED_FACTOR * td->nb_threads);
+		if (chunk < CLAIM_MIN_CHUNK)
+			chunk = remaining < CLAIM_MIN_CHUNK ? remaining : CLAIM_MIN_CHUNK;
+		if (chunk > CLAIM_MAX_CHUNK)
+			chunk = CLAIM_MAX_CHUNK;
+		if (!td->next.compare_exchange_weak(start, start + chunk, std::memory_order_relaxed)) {
+			// `start` now holds the offset claimed by another worker
+			worker_claims.contention++;
+			continue;
 		}
-	}
-
-	// Merge found likely prime into shared vector (need to wait for mutex)
-	if (worker_primes.size() > 0) {
-		pthread_mutex_lock(&mutex_primes);
-		td->primes->insert(td->primes->end(), worker_primes.begin(), worker_primes.end());
-		pthread_mutex_unlock(&mutex_primes);
+		worker_claims.chunks++;
 
+		// Process each value of the chunk which survived the sieve, keep the likely primes
+		mpz_add_ui(worker->from.get_mpz_t(), td->base.get_mpz_t(), start);
+		mpz_add_ui(worker->to.get_mpz_t(), worker->from.get_mpz_t(), chunk);
+		result_buffer_start(buffer, td->slice, start, worker->from);
+		scan_interval(worker->from, worker->to, td->rounds, &worker->rng, td->sieve_primes, &worker_stats, [&](const mpz_class& i) {
+			result_buffer_push(buffer, i);
+		});
+		start = td->next.load(std::memory_order_relaxed);
 	}
 
-  	pthread_exit(EXIT_SUCCESS);
+	// Merge counters into shared data (need to wait for mutex)
+	pthread_mutex_lock(&mutex_stats);
+	td->stats.candidates += worker_stats.candidates;
+	td->stats.survivors += worker_stats.survivors;
+	if (td->claims != NULL) {
+		td->claims[worker->index].chunks += worker_claims.chunks;
+		td->claims[worker->index].contention += worker_claims.contention;
+	}
+	pthread_mutex_unlock(&mutex_stats);
 }
 
 /*
-* Thread function to find every primes between two mpz_class values.
-* data : `thread_data_2` pointeur
-* Process thread_data_2.intervals values (intervals.at(index) to intervals.at(index+1)) until every
-* intervals value are processed. When there are no more intervals, dump found potential primes into
-* thread_data_2.primes.
-* Requires mutex_primes & mutex_index initialised.
+* Pool job to find every primes between two mpz_class values.
+* worker : pool worker running the job.
+* tdi : data shared with the other workers.
+* Process the pieces of intervals given by thread_data_2.scheduler until there is no work left, push
+* each potential prime value into the result buffer of the worker.
 */
-void * compute_prime_2_worker(void * data) {
-	// Retrieve data from master
-	struct thread_data_2 * tdi = (struct thread_data_2 *) data;
-	// Local primes found by the worker. To be merge with tdi.primes when the worker is done
-	std::vector<mpz_class> worker_primes = {};
-	gmp_randclass *rnd = initialize_seed();
-
-	// While the are intervals to process
-	while (true) {
-		// Take a new interval of values, if no more intervals, stop.
-		pthread_mutex_lock(&mutex_index);
-		if (tdi->index == -1) {
-			pthread_mutex_unlock(&mutex_index);
-			break;
-		}
-		// Take the new interval
-		mpz_class from, to;
-		try {
-			from = tdi->intervals->at(tdi->index);
-			to = tdi->intervals->at(tdi->index + 1);
-		} catch (std::out_of_range & oor) {
-			tdi->index = -1;
-			pthread_mutex_unlock(&mutex_index);
-			break;
-		}
-		// Bump index for other workers
-		tdi->index+=2;
-		pthread_mutex_unlock(&mutex_index);
-		
-		// Process each value in the interval
-		for (mpz_class i = from; mpz_cmp(i.get_mpz_t(), to.get_mpz_t()) < 0; i++) {
-			if (prob_prime(i, tdi->rounds, rnd)) { // If the number is likely prime, keep it
-				worker_primes.push_back(i);
-			}
-		}
+void compute_prime_2_worker(pool_worker * worker, thread_data_2 * tdi) {
+	// Primes found by the worker, a run per piece
+	result_buffer * buffer = &tdi->results->at(worker->index);
+	sieve_stats worker_stats{};
+	steal_range piece;
+
+	// While the are pieces to process, either ours or stolen from another worker
+	while (tdi->scheduler->next(worker->index, &piece)) {
+		const mpz_class& base = tdi->scheduler->base(piece.slice);
+		mpz_add_ui(worker->from.get_mpz_t(), base.get_mpz_t(), piece.begin);
+		mpz_add_ui(worker->to.get_mpz_t(), base.get_mpz_t(), piece.end);
+
+		// Process each value of the piece which survived the sieve, keep the likely primes
+		result_buffer_start(buffer, piece.slice, piece.begin, worker->from);
+		auto push = [&](const mpz_class& i) {
+			result_buffer_push(buffer, i);
+		};
+		if (tdi->tuples != NULL)
+			scan_tuples(worker->from, worker->to, tdi->rounds, &worker->rng, tdi->tuples, &worker_stats, push);
+		else
+			scan_interval(worker->from, worker->to, tdi->rounds, &worker->rng, tdi->sieve_primes, &worker_stats, push);
 	} 
 
-	// Merge local primes with tdi.primes
-	if (worker_primes.size() > 0) {
-		pthread_mutex_lock(&mutex_primes);
-		tdi->primes->insert(tdi->primes->end(), worker_primes.begin(), worker_primes.end());
-		pthread_mutex_unlock(&mutex_primes);
-	}
-	delete(rnd);
-	pthread_exit(EXIT_SUCCESS);
+	// Merge local counters with tdi.stats
+	pthread_mutex_lock(&mutex_stats);
+	tdi->stats.candidates += worker_stats.candidates;
+	tdi->stats.survivors += worker_stats.survivors;
+	pthread_mutex_unlock(&mutex_stats);
+}
+
+/*
+* Merge the result buffers of the workers into a sorted list, the workers of `pool` moving each a
+* part of the runs.
+* bases : first value of each slice, by slice number.
+*
+* return : list of the primes of every buffer, in ascending order. The pointer needs to be deleted
+* by the caller.
+*/
+PrimeList* merge_results(ThreadPool * pool, std::vector<result_buffer> * results, const std::vector<mpz_class> * bases) {
+	PrimeList * primes = new PrimeList();
+	ResultMerge merge(results, bases, primes);
+	pool->run([&](pool_worker * worker) {
+		merge.move(worker->index, pool->size());
+	});
+	return primes; // property of caller
 }
 
 /*
-* Find every (likely) primes in the `intervals`, threaded on `nb_threads`.
+* Find every (likely) primes in the `intervals`, threaded on the workers of `pool`.
+* pool : worker pool running the computation.
 * intervals : vector of values representing intervals, [lower_bound1, upper_bound1, lower_bound2,
-* upper_bound2, ...]. 
+* upper_bound2, ...], sorted and not overlapping (see `merge_intervals`).
 * rounds : number of miller-rabin approximation rounds, the higher the more precision, but the more
 * compute time.
-* nb_threads : number of parallel threads launched.
+* sieve_primes : small primes used to sieve the intervals (see `small_primes`).
+* stats : sieve counters, incremented by the workers.
+* claims : array of `pool->size()` work distribution counters, incremented by the workers. May be
+* NULL.
 *
-* return : vector of unordered likely primes found in the intervals. The pointer needs to be deleted
-* by the caller. 
+* return : list of likely primes found in the intervals, in ascending order. The pointer needs to
+* be deleted by the caller. 
 *
-* This function relies on `compute_prime_1_worker` function. For each intervals, launch `nb_threads`
-* to find every likely primes.
+* This function relies on `compute_prime_1_worker` function. For each intervals, every worker of
+* the pool claims chunks of the interval until it is done.
 */
-std::vector<mpz_class>* compute_prime_1(std::vector<mpz_class> * intervals, int rounds, int nb_threads) {
-	// Init result vector and mutex
-	std::vector<mpz_class> * primes = new std::vector<mpz_class>;
-	pthread_mutex_init(&mutex_count, NULL);
-	pthread_mutex_init(&mutex_primes, NULL);
-
-	// Declared threads 
-	pthread_t ids[nb_threads];
+PrimeList* compute_prime_1(ThreadPool * pool, std::vector<mpz_class> * intervals, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, claim_stats * claims) {
+	// Result buffers, one per worker
+	std::vector<result_buffer> results(pool->size());
+	// First value of each slice
+	std::vector<mpz_class> bases;
+
 	// For each intervals
 	for (int j = 0; j < intervals->size(); j+=2) {
-		// Create data structure shared by amoung the threads
-		struct thread_data_1 td;
-		td.rounds = rounds;
-		td.count = intervals->at(j);
-		td.max = intervals->at(j+1);
-		td.primes = primes;
-		td.rnd = initialize_seed();
-
-		// Run the threads, each thread will pick a number in the interval when he is ready
-		/*
-		* NOTE: Creating nb_threads for each interval is expensive, mostly when there is a lot of
-		* small intervals. If it is the type of input data you have, maybe consider using
-		* `compute_prime_2` which provides better performances for this case (but worst for few big
-		* sized intervals). 
-		*/
-		for(int i = 0; i < nb_threads; i++)
-			pthread_create(&ids[i], NULL, &compute_prime_1_worker, &td);
-
-		// Wait for all thread to finish their job
-		for(int i = 0; i < nb_threads; i++)
-			pthread_join(ids[i], NULL);
+		mpz_class base = intervals->at(j);
+		const mpz_class& max = intervals->at(j+1);
+		// Offsets are 64 bits, longer intervals are processed in several slices
+		while (base < max) {
+			mpz_class length = max - base;
+			if (!fits_u64(length))
+				length = UINT64_MAX;
+
+			// Create data structure shared by amoung the workers
+			struct thread_data_1 td{};
+			td.rounds = rounds;
+			td.base = base;
+			td.length = mpz_get_ui(length.get_mpz_t());
+			td.next = 0;
+			td.nb_threads = pool->size();
+			td.results = &results;
+			td.slice = bases.size();
+			bases.push_back(base);
+			td.sieve_primes = sieve_primes;
+			td.claims = claims;
+
+			// Wake the workers up, each one claims chunks of the interval when it is ready
+			pool->run([&](pool_worker * worker) {
+				compute_prime_1_worker(worker, &td);
+			});
+			stats->candidates += td.stats.candidates;
+			stats->survivors += td.stats.survivors;
+			base += length;
+		}
 	}
 
-    return primes; // property of caller
+	return merge_results(pool, &results, &bases); // property of caller
 }
 
 /*
-* Find every (likely) primes in the `intervals`, threaded on `nb_threads`.
+* Find every (likely) primes in the `intervals`, threaded on the workers of `pool`.
+* pool : worker pool running the computation.
 * intervals : vector of values representing intervals, [lower_bound1, upper_bound1, lower_bound2,
-* upper_bound2, ...].
+* upper_bound2, ...], sorted and not overlapping (see `merge_intervals`).
 * rounds : number of miller-rabin approximation rounds, the higher the more precision, but the more
 * compute time.
-* nb_threads : number of parallel threads launched.
+* sieve_primes : small primes used to sieve the intervals (see `small_primes`).
+* model : expected cost of the intervals, used to deal them to the workers (see
+* `StealScheduler::plan`). May be NULL, intervals are then dealt round robin.
+* stats : sieve counters, incremented by the workers.
+* steals : array of `pool->size()` scheduling counters, incremented by the workers. May be NULL.
+* tuples : joint sieve of a constellation (see `tuple_sieve_new`), the first member p of each
+* tuple of likely primes is then found instead of the primes. NULL for the primes.
 *
-* return : vector of unordered likely primes found in the intervals. The pointer needs to be deleted
-* by the caller. 
+* return : list of likely primes found in the intervals, in ascending order. The pointer needs to
+* be deleted by the caller. 
 *
-* This function relies on `compute_prime_2_worker` function.
+* This function relies on `compute_prime_2_worker` function. Intervals are dealt to the workers,
+* which split and steal them from each other (see `StealScheduler`), so a long interval is shared by
+* every worker once the others are done.
 */
-std::vector<mpz_class>* compute_prime_2(std::vector<mpz_class> * intervals, int rounds, int nb_threads) {
-	// Init result vector and mutex
-	std::vector<mpz_class> * primes = new std::vector<mpz_class>;
-	pthread_mutex_init(&mutex_index, NULL);
-	pthread_mutex_init(&mutex_primes, NULL);
-
-	// Declare threads
-	pthread_t ids[nb_threads];
+PrimeList* compute_prime_2(ThreadPool * pool, std::vector<mpz_class> * intervals, int rounds, const std::vector<uint32_t> * sieve_primes, const cost_model * model, sieve_stats * stats, steal_stats * steals, const tuple_sieve * tuples) {
+	// Result buffers, one per worker
+	std::vector<result_buffer> results(pool->size());
+	StealScheduler scheduler(pool->size());
+	for (int i = 0; i < intervals->size(); i+=2)
+		scheduler.add_interval(intervals->at(i), intervals->at(i+1));
+	if (model != NULL)
+		scheduler.plan(model);
 
-	// Create thread data shared amoung every threads
+	// Create thread data shared amoung every workers
 	struct thread_data_2 tdi{};
-	tdi.intervals = intervals;
+	tdi.scheduler = &scheduler;
 	tdi.rounds = rounds;
-	tdi.primes = primes;
-	tdi.index = 0;
+	tdi.results = &results;
+	tdi.sieve_primes = sieve_primes;
+	tdi.tuples = tuples;
 
-	// Launch threads
-	for (int i = 0; i < nb_threads; i++)
-		pthread_create(&ids[i], NULL, &compute_prime_2_worker, &tdi);
-	
-	// Wait for every threads to finish
-	for (int i = 0; i < nb_threads; i++)
-		pthread_join(ids[i], NULL);
-	
-	return primes; // property of caller
+	// Every worker takes pieces until there is none left
+	pool->run([&](pool_worker * worker) {
+		compute_prime_2_worker(worker, &tdi);
+	});
+
+	stats->candidates += tdi.stats.candidates;
+	stats->survivors += tdi.stats.survivors;
+	if (steals != NULL) {
+		for (int i = 0; i < pool->size(); i++) {
+			steals[i].pieces += scheduler.stats(i).pieces;
+			steals[i].steals += scheduler.stats(i).steals;
+		}
+	}
+	return merge_results(pool, &results, &scheduler.bases()); // property of caller
 }
 
 /*
 * Find every (likely) primes in the `intervals`.
 * intervals : vector of values representing intervals, [lower_bound1, upper_bound1, lower_bound2,
-* upper_bound2, ...].
+* upper_bound2, ...], sorted and not overlapping (see `merge_intervals`).
 * rounds : number of miller-rabin approximation rounds, the higher the more precision, but the more
 * compute time.
+* sieve_primes : small primes used to sieve the intervals (see `small_primes`).
+* stats : sieve counters.
+* seed : seed of the miller-rabin witnesses.
 *
-* return : vector of unordered likely primes found in the intervals. The pointer needs to be deleted
-* by the caller.
+* return : list of likely primes found in the intervals, in ascending order. The pointer needs to
+* be deleted by the caller.
 */
-std::vector<mpz_class>* compute_prime_unthreaded(std::vector<mpz_class> * intervals, int rounds) {
-	// Init result vector and random number generator
-	std::vector<mpz_class> * primes = new std::vector<mpz_class>;
-	gmp_randclass *rnd = initialize_seed();
+PrimeList* compute_prime_unthreaded(std::vector<mpz_class> * intervals, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, uint64_t seed) {
+	// Init result list and random stream
+	PrimeList * primes = new PrimeList();
+	witness_rng rng;
+	witness_rng_init(&rng, seed, 0);
 	// Loop through every intervals
 	for (int i = 0; i < intervals->size(); i+=2) {
 		// Lower bound
 		mpz_class from = intervals->at(i);
 		// Upper bound
 		mpz_class to = intervals->at(i+1);
-		// Remove them `from` and `to` from the intervals
-		// Loop Through every values of the interval
-		for (mpz_class j = from; mpz_cmp(j.get_mpz_t(), to.get_mpz_t()) < 0; j++) {
-			if (prob_prime(j, rounds, rnd)) { // If the target value is likely prime, store it in result vector
-				primes->push_back(j);
-			}
+		// Loop Through every values of the interval which survived the sieve, store the likely primes
+		scan_interval(from, to, rounds, &rng, sieve_primes, stats, [&](const mpz_class& j) {
+			primes->push(j);
+		});
+	}
+
+	return primes; // property of caller
+}
+
+/*
+* Find the strategy named `name` ("auto", "unthreaded", "number" or "interval").
+* return : false if there is no such strategy, `strategy` is then unchanged.
+*/
+bool compute_strategy_parse(const std::string& name, compute_strategy * strategy) {
+	for (int i = 0; i < STRATEGY_COUNT; i++) {
+		if (name == compute_strategy_names[i]) {
+			*strategy = (compute_strategy) i;
+			return true;
 		}
 	}
+	return false;
+}
 
+/*
+* Pick the strategy of each interval from its expected cost, which accounts for its length and the
+* bit size of its values (see `cost_model`):
+* - every interval is scanned unthreaded if there is a single worker, or if the whole file is
+* cheaper than STRATEGY_UNTHREADED_COST;
+* - an interval heavy enough to keep every worker busy on its own (at least 1 / nb_threads of the
+* total cost, and CLAIM_MIN_CHUNK values per worker) is scanned by number;
+* - the other ones are scanned by interval.
+* A few long intervals are then scanned by number and many short ones by interval, a mix of both
+* alternates between the two strategies.
+* intervals : sorted and not overlapping (see `merge_intervals`).
+*
+* return : strategy of each interval.
+*/
+std::vector<compute_strategy> strategy_plan(const std::vector<mpz_class> * intervals, const cost_model * model, int nb_threads) {
+	std::vector<double> costs(intervals->size() / 2);
+	double total = 0;
+	for (size_t i = 0; i < costs.size(); i++) {
+		costs[i] = cost_model_estimate(model, intervals->at(2 * i), intervals->at(2 * i + 1));
+		total += costs[i];
+	}
+	if (nb_threads <= 1 || total < STRATEGY_UNTHREADED_COST)
+		return std::vector<compute_strategy>(costs.size(), STRATEGY_UNTHREADED);
+	std::vector<compute_strategy> plan(costs.size(), STRATEGY_INTERVAL);
+	for (size_t i = 0; i < costs.size(); i++) {
+		mpz_class length = intervals->at(2 * i + 1) - intervals->at(2 * i);
+		if (costs[i] * nb_threads >= total && length >= (unsigned long) CLAIM_MIN_CHUNK * nb_threads)
+			plan[i] = STRATEGY_NUMBER;
+	}
+	return plan;
+}
+
+/*
+* Find every (likely) primes in the `intervals` with `strategy`, see `compute_prime_unthreaded`,
+* `compute_prime_1` and `compute_prime_2` for the other parameters. With STRATEGY_AUTO, each run of
+* consecutive intervals given the same strategy by `strategy_plan` is scanned on its own, then the
+* primes of the runs are appended in order.
+* chosen : strategy counters, incremented.
+*
+* return : list of likely primes found in the intervals, in ascending order. The pointer needs to
+* be deleted by the caller.
+*/
+PrimeList* compute_prime(ThreadPool * pool, std::vector<mpz_class> * intervals, compute_strategy strategy, int rounds, const std::vector<uint32_t> * sieve_primes, const cost_model * model, uint64_t seed, sieve_stats * stats, claim_stats * claims, steal_stats * steals, strategy_stats * chosen) {
+	std::vector<compute_strategy> plan;
+	if (strategy == STRATEGY_AUTO)
+		plan = strategy_plan(intervals, model, pool->size());
+	else
+		plan.assign(intervals->size() / 2, strategy);
+	PrimeList * primes = new PrimeList();
+	for (size_t begin = 0; begin < plan.size();) {
+		size_t end = begin + 1;
+		while (end < plan.size() && plan[end] == plan[begin])
+			end++;
+		// Intervals of the run, `intervals` itself if there is a single run
+		std::vector<mpz_class> run;
+		std::vector<mpz_class> * part = intervals;
+		if (begin > 0 || end < plan.size()) {
+			run.assign(intervals->begin() + 2 * begin, intervals->begin() + 2 * end);
+			part = &run;
+		}
+		PrimeList * found;
+		if (plan[begin] == STRATEGY_UNTHREADED)
+			found = compute_prime_unthreaded(part, rounds, sieve_primes, stats, seed);
+		else if (plan[begin] == STRATEGY_NUMBER)
+			found = compute_prime_1(pool, part, rounds, sieve_primes, stats, claims);
+		else
+			found = compute_prime_2(pool, part, rounds, sieve_primes, model, stats, steals, NULL);
+		chosen->intervals[plan[begin]] += end - begin;
+		primes->append(found);
+		delete(found);
+		begin = end;
+	}
 	return primes; // property of caller
 }
 
+/*
+* Body of the thread of a pipeline stage.
+* data : `std::function<void()>` pointer running the stage.
+*/
+void * run_stage(void * data) {
+	(*(std::function<void()> *) data)();
+	return NULL;
+}
+
+/*
+* Find every (likely) primes of the intervals read by `pipeline` and write them on the standard
+* output as soon as they are found, in ascending order, see `Pipeline`. The reader, merger and
+* writer stages run on threads of their own, the workers of `pool` are the scanners.
+* pipeline : stages, created for `pool->size()` scanners. Holds the counters and the errors once
+* the function returns.
+* binary : writer of the binary output (see `PrimeWriter`), NULL to write the primes in decimal.
+* checkpoint : checkpoints of the progress, `binary` being its writer. May be NULL.
+*/
+void compute_prime_stream(ThreadPool * pool, Pipeline * pipeline, PrimeWriter * binary, Checkpoint * checkpoint) {
+	std::function<void()> stages[3] = {
+		[&]() { pipeline->read(); },
+		[&]() { pipeline->merge(); },
+		[&]() {
+			if (binary != NULL)
+				pipeline->write(binary, checkpoint);
+			else
+				pipeline->write(std::cout, ' ');
+		},
+	};
+	pthread_t threads[3];
+	for (int i = 0; i < 3; i++)
+		pthread_create(&threads[i], NULL, &run_stage, &stages[i]);
+	pool->run([&](pool_worker * worker) {
+		pipeline->scan(&worker->rng);
+	});
+	for (int i = 0; i < 3; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/*
+* Print the GMP allocations done during a computation and their number per value tested by
+* miller-rabin.
+* before, after : counts at the start and at the end of the computation.
+* tested : number of values tested by miller-rabin.
+*/
+void alloc_counts_print(const alloc_counts * before, const alloc_counts * after, uint64_t tested) {
+	uint64_t allocs = after->allocs - before->allocs;
+	uint64_t reallocs = after->reallocs - before->reallocs;
+	std::cerr << "gmp: " << allocs << " allocations, " << reallocs << " reallocations, "
+		<< (tested ? (double) (allocs + reallocs) / tested : 0) << " per tested value" << std::endl;
+}
+
+/*
+* Print the work distribution counters of each `compute_prime_1_worker` on the error output.
+*/
+void claim_stats_print(const claim_stats * claims, int nb_threads) {
+	for (int i = 0; i < nb_threads; i++)
+		std::cerr << "thread " << i << ": " << claims[i].chunks << " chunks claimed, " << claims[i].contention << " contended claims" << std::endl;
+}
+
+/*
+* Print the number of intervals scanned with each strategy on the error output.
+*/
+void strategy_stats_print(const strategy_stats * chosen) {
+	std::cerr << "strategy: intervals";
+	for (int i = STRATEGY_UNTHREADED; i < STRATEGY_COUNT; i++)
+		std::cerr << (i > STRATEGY_UNTHREADED ? ", " : " ") << chosen->intervals[i] << " " << compute_strategy_names[i];
+	std::cerr << std::endl;
+}
+
+/*
+* Print the scheduling counters of each `compute_prime_2_worker` on the error output.
+*/
+void steal_stats_print(const steal_stats * steals, int nb_threads) {
+	for (int i = 0; i < nb_threads; i++)
+		std::cerr << "thread " << i << ": " << steals[i].pieces << " pieces, " << steals[i].steals << " steals" << std::endl;
+}
+
+/*
+* Merge the intervals, to reduce overlapping and to not check if a number is prime multiples times.
+* intervals : vector of values representing intervals, [lower_bound1, upper_bound1, lower_bound2,
+* upper_bound2, ...].
+*
+* return : merged intervals sorted by lower bound, same layout as `intervals`. The pointer needs to
+* be deleted by the caller.
+*/
+std::vector<mpz_class>* merge_intervals(const std::vector<mpz_class> * intervals) {
+	// Sort intervals by lower bound
+	std::vector<size_t> order(intervals->size() / 2);
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return intervals->at(2 * a) < intervals->at(2 * b);
+	});
+	std::vector<mpz_class> * merged = new std::vector<mpz_class>();
+
+	for (size_t i : order) {
+		const mpz_class& from = intervals->at(2 * i);
+		const mpz_class& to = intervals->at(2 * i + 1);
+		// if the list of merged intervals is empty or if the current interval does not overlap with
+		// the previous interval, append it.
+		if (merged->empty() || merged->back() < from) {
+			merged->push_back(from);
+			merged->push_back(to);
+		} else if (merged->back() < to) {
+			// there is overlap, so we merge the current and previous intervals.
+			merged->back() = to;
+		}
+	}
+	return merged; // property of caller
+}
+
+/*
+* Read the intervals of an input file (see `IntervalReader` for the format), each worker of the pool
+* parsing a part of the file.
+*
+* return : vector of values [A, B, C, D, ...], NULL if the file can't be opened or a line is
+* malformed. The pointer needs to be deleted by the caller.
+*/
+std::vector<mpz_class>* read_intervals(ThreadPool * pool, const std::string& path) {
+	IntervalReader reader(path, pool->size());
+	if (!reader.is_open())
+		return NULL;
+	pool->run([&](pool_worker * worker) {
+		reader.parse(worker->index);
+	});
+	return reader.values(); // property of caller
+}
+
+/*
+* Serve the batches of intervals sent to the socket at `path` (see `QueryServer`) until SIGINT or
+* SIGTERM. The workers, with their random streams and scratch values, the small primes and the cost
+* model are kept from one batch to the next.
+* print_stats : print the counters of each batch on the error output.
+*
+* return : exit status of the program.
+*/
+int serve(const std::string& path, ThreadPool * pool, compute_strategy strategy, int rounds, const std::vector<uint32_t> * sieve_primes, const cost_model * model, uint64_t seed, bool print_stats) {
+	QueryServer server(path);
+	if (!server.is_open()) {
+		std::cerr << "error: can\'t listen on socket at : " << path << std::endl;
+		return EXIT_FAILURE;
+	}
+	// The first batch does not pay for the allocations, the unthreaded strategy runs on this thread
+	pool->run([](pool_worker * worker) {
+		prob_prime_reserve(SERVE_WARM_BITS);
+	});
+	prob_prime_reserve(SERVE_WARM_BITS);
+	std::vector<mpz_class> intervals;
+	while (server.next(&intervals)) {
+		if (server.malformed()) {
+			server.reply_error("malformed intervals");
+			continue;
+		}
+		// Compute time, reply included
+		Chrono c(true);
+		std::vector<mpz_class> * merged = merge_intervals(&intervals);
+		sieve_stats stats{};
+		strategy_stats chosen{};
+		PrimeList * primes = compute_prime(pool, merged, strategy, rounds, sieve_primes, model, seed, &stats, NULL, NULL, &chosen);
+		server.reply(primes);
+		c.pause();
+		if (print_stats) {
+			std::cerr << "batch: " << merged->size() / 2 << " intervals, " << primes->size() << " primes, " << c.get() << " s" << std::endl;
+			sieve_stats_print(&stats);
+			strategy_stats_print(&chosen);
+		}
+		delete(merged);
+		delete(primes);
+	}
+	return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv) {
 	// Parse args
 	if (argc < 3) {
-		std::cerr << "usage: executable <nb_threads> <filepath> [rounds]" << std::endl; 
+		std::cerr << "usage: executable <nb_threads> <filepath> [rounds] [--sieve=<bound>] [--stats] [--test=mr|fixed|bpsw] [--seed=<seed>] [--strategy=auto|unthreaded|number|interval] [--stream] [--format=text|binary] [--offsets] [--cache=<directory>] [--checkpoint=<filepath> [--resume]] [--file=<filepath>]... [--serve] [--count|--first=<k>|--next|--prev] [--tuple=twin|cousin|sophie]" << std::endl; 
 		return EXIT_FAILURE;
 	}
 	unsigned int rounds = 5;
 	unsigned int nb_thread;
+	// Upper bound of the small primes used to sieve the intervals (0 to disable the sieve)
+	uint32_t sieve_bound = SIEVE_DEFAULT_BOUND;
+	// Print the sieve counters on the error output
+	bool print_stats = false;
+	// Primality test of the values larger than 64 bits
+	prime_test test = PRIME_TEST_MR_RANDOM;
+	// Seed of the miller-rabin witnesses, a run is reproduced by giving its seed back
+	uint64_t seed = time(NULL);
+	// Input files, processed in order by the same workers
+	std::vector<std::string> paths = {argv[2]};
+	// Parallelization of the batch computation (see `compute_prime`), forced for benchmarks
+	compute_strategy strategy = STRATEGY_AUTO;
+	// Write the primes as they are found, with a memory bounded by the pipeline queues
+	bool stream = false;
+	// Write the primes in the binary format of prime-file.hpp instead of decimal
+	bool binary = false;
+	// Write the offsets of the primes from the lower bound of their interval instead of the primes
+	bool offsets = false;
+	// Directory of the cache of the scanned ranges (see `RangeCache`), empty for no cache
+	std::string cache_dir;
+	// Results file of a checkpointed run (see `Checkpoint`), empty for no checkpoint
+	std::string checkpoint_path;
+	// Go on from the last checkpoint instead of starting over
+	bool resume = false;
+	// Serve the batches sent to the socket given instead of the input file (see `serve`)
+	bool server = false;
+	// Answer printed instead of the primes, for --next and --prev the value is given instead of the
+	// input file
+	query_mode query = QUERY_NONE;
+	// Number of primes printed by --first
+	uint64_t first = 0;
+	// Set if more than one query is asked
+	bool queries = false;
+	// Constellation whose first members are printed instead of the primes (see prime-tuple.hpp)
+	const prime_tuple * tuple = NULL;
 
     nb_thread = atoi(argv[1]);
-    if (argc >= 4)
-        rounds = atoi(argv[3]);
-    
-	/* Read input file
-	 * Expected format is the following :
-	 * A B
-	 * C D
-	 * ...
-	 * Meaning intervals are : 
-	 * [[A, B], [C, D], ...] 
-	 */
-	std::ifstream file;
-	file.open(argv[2]);
-	if (file.is_open()) {
-	
-		std::vector<mpz_class> * intervals = new std::vector<mpz_class>();
-		std::string line;
-
-		// For each line, parse to find substring<space>substring, 
-		// then tries to parse each substring into long integers (base10)
-		// represented by GMP as a mpz_class type.
-		while (getline(file, line)) {
-			std::istringstream iss(line);
-			std::string val;
-			iss >> val;
-			intervals->push_back(mpz_class(val));
-			iss >> val;
-			intervals->push_back(mpz_class(val));
+	// Without any worker the pipeline of --stream and --checkpoint never ends
+	if (atoi(argv[1]) < 1) {
+		std::cerr << "error: nb_threads must be at least 1" << std::endl;
+		return EXIT_FAILURE;
+	}
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.rfind("--sieve=", 0) == 0)
+			sieve_bound = std::stoul(arg.substr(8));
+		else if (arg == "--stats")
+			print_stats = true;
+		else if (arg.rfind("--test=", 0) == 0) {
+			if (!prime_test_parse(arg.substr(7), &test)) {
+				std::cerr << "error: unknown primality test : " << arg.substr(7) << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.rfind("--seed=", 0) == 0)
+			seed = std::stoull(arg.substr(7));
+		else if (arg.rfind("--strategy=", 0) == 0) {
+			if (!compute_strategy_parse(arg.substr(11), &strategy)) {
+				std::cerr << "error: unknown strategy : " << arg.substr(11) << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--stream")
+			stream = true;
+		else if (arg.rfind("--format=", 0) == 0) {
+			if (arg != "--format=text" && arg != "--format=binary") {
+				std::cerr << "error: unknown output format : " << arg.substr(9) << std::endl;
+				return EXIT_FAILURE;
+			}
+			binary = arg == "--format=binary";
+		}
+		else if (arg == "--offsets")
+			offsets = true;
+		else if (arg.rfind("--checkpoint=", 0) == 0)
+			checkpoint_path = arg.substr(13);
+		else if (arg == "--resume")
+			resume = true;
+		else if (arg.rfind("--cache=", 0) == 0)
+			cache_dir = arg.substr(8);
+		else if (arg.rfind("--file=", 0) == 0)
+			paths.push_back(arg.substr(7));
+		else if (arg == "--serve")
+			server = true;
+		else if (arg == "--count" || arg.rfind("--first=", 0) == 0 || arg == "--next" || arg == "--prev") {
+			queries = query != QUERY_NONE;
+			if (arg == "--count")
+				query = QUERY_COUNT;
+			else if (arg == "--next")
+				query = QUERY_NEXT;
+			else if (arg == "--prev")
+				query = QUERY_PREV;
+			else {
+				query = QUERY_FIRST;
+				first = std::stoull(arg.substr(8));
+			}
+		}
+		else if (arg.rfind("--tuple=", 0) == 0) {
+			tuple = prime_tuple_find(arg.substr(8));
+			if (tuple == NULL) {
+				std::cerr << "error: unknown constellation : " << arg.substr(8) << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else
+			rounds = atoi(argv[i]);
+	}
+
+	// Checkpoints follow the progress of the pipeline
+	if (!checkpoint_path.empty())
+		stream = true;
+	if (stream && !cache_dir.empty()) {
+		std::cerr << "error: --cache can't be used with --stream or --checkpoint" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (server && (stream || !cache_dir.empty() || paths.size() > 1)) {
+		std::cerr << "error: --serve can't be used with --stream, --checkpoint, --cache or --file" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (queries || (query != QUERY_NONE && (stream || server || binary || !cache_dir.empty()))) {
+		std::cerr << "error: a single query of --count, --first, --next and --prev, without --stream, --checkpoint, --serve, --format=binary or --cache" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (tuple != NULL && (stream || server || query != QUERY_NONE || !cache_dir.empty() || strategy != STRATEGY_AUTO)) {
+		std::cerr << "error: --tuple can't be used with --stream, --checkpoint, --serve, a query, --cache or --strategy" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (offsets && (binary || stream || server || query != QUERY_NONE)) {
+		std::cerr << "error: --offsets can't be used with --format=binary, --stream, --checkpoint, --serve or a query" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (stream && strategy != STRATEGY_AUTO) {
+		std::cerr << "error: --strategy can't be used with --stream or --checkpoint" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if ((resume && checkpoint_path.empty()) || (!checkpoint_path.empty() && paths.size() > 1)) {
+		std::cerr << "error: --resume needs --checkpoint, which takes a single input file" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	prob_prime_set_test(test);
+	// Count the GMP allocations from the start, so every value is allocated through the counter
+	if (print_stats)
+		alloc_counter_install();
+	std::vector<uint32_t> * sieve_primes = small_primes(sieve_bound);
+	// Expected cost of the intervals, measured once for every input file. Not needed to search
+	// around a single value
+	cost_model * model = NULL;
+	if (query != QUERY_NEXT && query != QUERY_PREV)
+		model = cost_model_calibrate(rounds, sieve_primes);
+	if (print_stats) {
+		std::cerr << "seed: " << seed << std::endl;
+		if (model != NULL)
+			cost_model_print(model);
+	}
+	// Sieve tables of the constellation, shared by every input file
+	std::unique_ptr<tuple_sieve> tuples(tuple == NULL ? NULL : tuple_sieve_new(tuple, sieve_primes));
+	// Workers kept alive for every input file
+	ThreadPool pool(nb_thread, seed);
+	if (server) {
+		int status = serve(paths[0], &pool, strategy, rounds, sieve_primes, model, seed, print_stats);
+		delete(sieve_primes);
+		delete(model);
+		return status;
+	}
+	if (query == QUERY_NEXT || query == QUERY_PREV) {
+		mpz_class value, prime;
+		if (paths.size() > 1 || value.set_str(paths[0], 10) != 0) {
+			std::cerr << "error: --next and --prev take a single integer instead of the input file : " << paths[0] << std::endl;
+			delete(sieve_primes);
+			delete(model);
+			return EXIT_FAILURE;
+		}
+		sieve_stats stats{};
+		Chrono c(true);
+		bool found = true;
+		if (query == QUERY_NEXT)
+			next_prime(&pool, value, rounds, sieve_primes, &stats, &prime);
+		else
+			found = prev_prime(&pool, value, rounds, sieve_primes, &stats, &prime);
+		c.pause();
+		if (found)
+			std::cout << prime << std::endl;
+		else
+			std::cerr << "error: no prime lower than : " << value << std::endl;
+		std::cerr << c.get() << std::endl;
+		if (print_stats)
+			sieve_stats_print(&stats);
+		delete(sieve_primes);
+		delete(model);
+		return found ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// Binary output of every input file, in order
+	std::unique_ptr<PrimeWriter> writer(binary && checkpoint_path.empty() ? new PrimeWriter(std::cout) : NULL);
+	// Ranges scanned by previous files and runs
+	std::unique_ptr<RangeCache> cache(cache_dir.empty() ? NULL : new RangeCache(cache_dir, test, rounds));
+	if (cache && !cache->is_open()) {
+		std::cerr << "error: can\'t open cache at : " << cache_dir << std::endl;
+		delete(sieve_primes);
+		delete(model);
+		return EXIT_FAILURE;
+	}
+	for (const std::string& path : paths) {
+		if (stream) {
+			IntervalReader reader(path, 1);
+			if (!reader.is_open()) {
+				std::cerr << "error: can\'t read intervals from file at : " << path << std::endl;
+				delete(sieve_primes);
+				delete(model);
+				return EXIT_FAILURE;
+			}
+			Pipeline pipeline(&reader, nb_thread, rounds, sieve_primes);
+			// Primes go to the results file of the checkpoints, then to the output once they are all found
+			std::unique_ptr<Checkpoint> checkpoint;
+			if (!checkpoint_path.empty()) {
+				checkpoint.reset(new Checkpoint(checkpoint_path, path, test, rounds));
+				if (!checkpoint->open(resume)) {
+					std::cerr << "error: " << checkpoint->error() << " : " << checkpoint_path << std::endl;
+					delete(sieve_primes);
+					delete(model);
+					return EXIT_FAILURE;
+				}
+				if (checkpoint->resumed())
+					pipeline.resume_from(checkpoint->high_water());
+			}
+			// GMP allocations before the computation
+			alloc_counts allocs = alloc_counter_get();
+			// Compute time, output included
+			Chrono c(true);
+			compute_prime_stream(&pool, &pipeline, checkpoint ? checkpoint->writer() : writer.get(), checkpoint.get());
+			c.pause();
+			alloc_counts allocs_end = alloc_counter_get();
+			if (checkpoint && !pipeline.malformed() && !checkpoint->dump(std::cout, binary, ' ')) {
+				std::cerr << "error: can\'t read the results back from : " << checkpoint_path << std::endl;
+				delete(sieve_primes);
+				delete(model);
+				return EXIT_FAILURE;
+			}
+			if (!binary)
+				std::cout << std::endl;
+			if (pipeline.malformed()) {
+				// Primes of the lines before the error are already written
+				std::cerr << "error: can\'t read intervals from file at : " << path << std::endl;
+				delete(sieve_primes);
+				delete(model);
+				return EXIT_FAILURE;
+			}
+			std::cerr << c.get() << std::endl;
+			if (print_stats) {
+				sieve_stats_print(&pipeline.stats());
+				std::cerr << "pipeline: " << pipeline.primes() << " primes in " << pipeline.tasks() << " tasks, at most " << pipeline.peak() << " tasks buffered" << std::endl;
+				alloc_counts_print(&allocs, &allocs_end, pipeline.stats().survivors);
+			}
+			continue;
+		}
+		std::vector<mpz_class> * intervals = read_intervals(&pool, path);
+		if (intervals == NULL) {
+			std::cerr << "error: can\'t read intervals from file at : " << path << std::endl;
+			delete(sieve_primes);
+			delete(model);
+			return EXIT_FAILURE;
+		}
+		// Overlapping intervals are only scanned once
+		std::vector<mpz_class> * merged = merge_intervals(intervals);
+		if (query == QUERY_COUNT || query == QUERY_FIRST) {
+			// Primes are counted or printed as they are found, never kept
+			sieve_stats stats{};
+			Chrono c(true);
+			if (query == QUERY_COUNT) {
+				std::cout << count_primes(&pool, merged, rounds, sieve_primes, model, &stats) << std::endl;
+			} else {
+				first_primes(&pool, merged, first, rounds, sieve_primes, &stats, [](const mpz_class& prime) {
+					std::cout << prime << " ";
+				});
+				std::cout << std::endl;
+			}
+			c.pause();
+			std::cerr << c.get() << std::endl;
+			if (print_stats)
+				sieve_stats_print(&stats);
+			delete(intervals);
+			delete(merged);
+			continue;
 		}
-		file.close();
 
-		// Vector of found likely primes in intervals
-		std::vector<mpz_class> * primes;
+		// List of found likely primes in intervals
+		PrimeList * primes;
+		sieve_stats stats{};
+		// Work distribution counters of compute_prime_1, one per thread
+		std::vector<claim_stats> claims(nb_thread);
+		// Scheduling counters of compute_prime_2, one per thread
+		std::vector<steal_stats> steals(nb_thread);
+		strategy_stats chosen{};
+		// GMP allocations before the computation
+		alloc_counts allocs = alloc_counter_get();
 		// Compute time
 		Chrono c(true);
-		// Launch computation for every intervals
-		// primes = compute_prime_unthreaded(intervals, rounds);
-		// primes = compute_prime_1(intervals, rounds, nb_thread);
-		primes = compute_prime_2(intervals, rounds, nb_thread);
+		// Only the parts of the intervals not found in the cache are scanned
+		std::vector<mpz_class> * scanned = cache ? cache->gaps(merged) : merged;
+		// Launch computation for every intervals, constellations are always dealt to the workers
+		// interval by interval
+		if (tuples)
+			primes = compute_prime_2(&pool, scanned, rounds, sieve_primes, model, &stats, steals.data(), tuples.get());
+		else
+			primes = compute_prime(&pool, scanned, strategy, rounds, sieve_primes, model, seed, &stats, claims.data(), steals.data(), &chosen);
+		if (cache) {
+			PrimeList * spliced = cache->splice(primes);
+			delete(scanned);
+			delete(primes);
+			if (spliced == NULL) {
+				std::cerr << "error: can\'t read the primes of cache at : " << cache_dir << std::endl;
+				delete(intervals);
+				delete(merged);
+				delete(sieve_primes);
+				delete(model);
+				return EXIT_FAILURE;
+			}
+			primes = spliced;
+		}
 		c.pause();
-		// Print every found likely primes in order
-		std::sort(primes->begin(), primes->end());
-		for (mpz_class p : *primes) {
-			std::cout << p << " ";
+		alloc_counts allocs_end = alloc_counter_get();
+		// Print every found likely primes, already in order
+		if (binary) {
+			for (size_t run = 0; run < primes->runs(); run++)
+				writer->run(primes->run_base(run), primes->run_offsets(run), primes->run_size(run));
+			writer->flush();
+		} else {
+			// Converted by the workers, then written past the buffer of std::cout
+			std::cout.flush();
+			if (!prime_text_write(&pool, primes, offsets ? merged : NULL, STDOUT_FILENO)) {
+				std::cerr << "error: can\'t write the primes" << std::endl;
+				delete(intervals);
+				delete(merged);
+				delete(primes);
+				delete(sieve_primes);
+				delete(model);
+				return EXIT_FAILURE;
+			}
 		}
-		std::cout << std::endl;
 		// Time to compute
 		std::cerr << c.get() << std::endl;
+		if (print_stats) {
+			sieve_stats_print(&stats);
+			strategy_stats_print(&chosen);
+			claim_stats_print(claims.data(), nb_thread);
+			steal_stats_print(steals.data(), nb_thread);
+			std::cerr << "results: " << primes->size() << " primes in " << primes->runs() << " runs, " << primes->memory() << " bytes" << std::endl;
+			alloc_counts_print(&allocs, &allocs_end, stats.survivors);
+			if (cache)
+				std::cerr << "cache: " << cache->cached() << " values cached, " << cache->scanned() << " values scanned" << std::endl;
+		}
 		
 		delete(intervals);
+		delete(merged);
 		delete(primes);
-	} else {
-		std::cerr << "error: can\'t open file at : " << argv[2] << std::endl;
-		return EXIT_FAILURE;
 	}
+	delete(sieve_primes);
+	delete(model);
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,43 @@
+/*
+ * AVX2 kernel of the lane parallel Miller-Rabin rounds (4 candidates per vector). This file is
+ * compiled with -mavx2 and only called when the CPU supports it, see `prob_prime_batch`.
+ */
+
+#include <immintrin.h>
+
+#include "miller-rabin-batch.hpp"
+
+namespace {
+
+struct avx2 {
+	static const size_t LANES = 4;
+	typedef __m256i vec;
+
+	static inline vec load(const uint64_t* p) {
+		return _mm256_loadu_si256((const __m256i*) p);
+	}
+	static inline void store(uint64_t* p, vec v) {
+		_mm256_storeu_si256((__m256i*) p, v);
+	}
+	static inline vec set1(uint64_t x) {
+		return _mm256_set1_epi64x(x);
+	}
+	static inline vec add(vec a, vec b) {
+		return _mm256_add_epi64(a, b);
+	}
+	static inline vec mul32(vec a, vec b) {
+		return _mm256_mul_epu32(a, b);
+	}
+	static inline vec and_(vec a, vec b) {
+		return _mm256_and_si256(a, b);
+	}
+	static inline vec srli(vec a, int n) {
+		return _mm256_srli_epi64(a, n);
+	}
+};
+
+} // namespace
+
+void mr_batch_round_avx2(mr_batch* batch, size_t first_lane, bool* passed) {
+	MrBatchRound<avx2>(batch, first_lane).run(passed);
+}
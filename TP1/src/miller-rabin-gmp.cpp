@@ -5,7 +5,12 @@
  * Distributed under the modified BSD license.
  */
 
+#include <array>
+#include <climits>
+#include <utility>
+
 #include "miller-rabin-gmp.hpp"
+#include "fixed-montgomery.hpp"
 
 /*
  * Calculates a^x mod n through modular exponentiation.
@@ -22,15 +27,13 @@ mpz_class pow_mod(mpz_class a, mpz_class x, const mpz_class& n)
 
 
 /*
- * Seeds the random number generator with random bytes from /dev/urandom or, if
- * bytes is zero, from the current time.
+ * Prepare the stream `stream` of `seed`. Streams of the same seed have unrelated keys, so workers
+ * started at the same time do not draw the same witnesses.
  */
-gmp_randclass * initialize_seed()
+void witness_rng_init(witness_rng* rng, uint64_t seed, uint64_t stream)
 {
-	gmp_randclass *res = new gmp_randclass(gmp_randinit_default);
-	// Seed with the current time
-	res->seed(time(NULL));
-	return res;
+	rng->key = witness_rng_mix(witness_rng_mix(seed) + stream * WITNESS_RNG_GAMMA);
+	rng->counter = 0;
 }
 
 /*
@@ -44,55 +47,297 @@ mpz_class randint(const mpz_class& lowest, const mpz_class& highest, gmp_randcla
 	return rnd->get_z_range(highest - lowest + 1) + lowest;
 }
 
+/*
+ * Preallocated values of the primality tests, one set per thread, so that testing a candidate does
+ * no heap allocation once the buffers are large enough (see `prob_prime_reserve`).
+ * n1 : n - 1 (n + 1 for the Lucas test).
+ * d : odd part of n1.
+ * a : witness.
+ * x : a^d mod n then its squares, holds a product before its reduction so it is twice as large.
+ * v, w : V_k and V_k+1 of the Lucas test, twice as large as n like x.
+ * bits : bit size the buffers are allocated for.
+ */
+struct mr_scratch {
+	mpz_class n1, d, a, x;
+	mpz_class v, w;
+	size_t bits = 0;
+};
+
+static thread_local mr_scratch scratch;
+
+/*
+ * Allocate the Miller-Rabin buffers of the calling thread for values of up to `bits` bits. Called
+ * once per interval, the buffers only grow.
+ */
+void prob_prime_reserve(size_t bits)
+{
+	if (bits <= scratch.bits)
+		return;
+	mpz_realloc2(scratch.n1.get_mpz_t(), bits);
+	mpz_realloc2(scratch.d.get_mpz_t(), bits);
+	mpz_realloc2(scratch.a.get_mpz_t(), bits);
+	mpz_realloc2(scratch.x.get_mpz_t(), 2 * bits + GMP_NUMB_BITS);
+	mpz_realloc2(scratch.v.get_mpz_t(), 2 * bits + GMP_NUMB_BITS);
+	mpz_realloc2(scratch.w.get_mpz_t(), 2 * bits + GMP_NUMB_BITS);
+	scratch.bits = bits;
+}
+
+/*
+ * Draws a uniform witness in [2, n - 2] into the `size` limbs of `a`, for n > 4 of `size` limbs (top
+ * limb not null): values of the bit size of n are drawn until one is below n - 3, at most two draws
+ * on average, then moved up by 2. Works on the limbs directly, small values never go through mpz.
+ */
+static void draw_witness_limbs(witness_rng* rng, const mp_limb_t* n, size_t size, mp_limb_t* a)
+{
+	const mp_limb_t mask = ~(mp_limb_t) 0 >> __builtin_clzll(n[size - 1]);
+	for (;;) {
+		for (size_t i = 0; i < size; i++)
+			a[i] = witness_rng_next(rng);
+		a[size - 1] &= mask;
+		// Keep a + 2 if a + 3 < n
+		if (mpn_add_1(a, a, size, 3) == 0 && mpn_cmp(a, n, size) < 0) {
+			mpn_sub_1(a, a, size, 1);
+			return;
+		}
+	}
+}
+
+/*
+ * Draws a uniform witness in [2, n - 2] into `a`, for n > 4, without temporary value.
+ */
+void draw_witness(const mpz_class& n, witness_rng* rng, mpz_class* a)
+{
+	const size_t size = mpz_size(n.get_mpz_t());
+	draw_witness_limbs(rng, mpz_limbs_read(n.get_mpz_t()), size, mpz_limbs_write(a->get_mpz_t(), size));
+	mpz_limbs_finish(a->get_mpz_t(), size);
+}
+
+// Test run by `prob_prime`, chosen once before any worker starts
+static prime_test selected_test = PRIME_TEST_MR_RANDOM;
+
+// Witnesses of PRIME_TEST_MR_FIXED: the first primes, in order
+static const unsigned long fixed_bases[] = {
+	2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97,
+	101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193,
+	197, 199, 211, 223, 227, 229
+};
+#define NB_FIXED_BASES (sizeof(fixed_bases) / sizeof(fixed_bases[0]))
+
+void prob_prime_set_test(prime_test test)
+{
+	selected_test = test;
+}
+
+prime_test prob_prime_get_test()
+{
+	return selected_test;
+}
+
+/*
+ * Parse the name of a test ("mr", "fixed" or "bpsw"). Returns false if the name is unknown.
+ */
+bool prime_test_parse(const std::string& name, prime_test* test)
+{
+	if (name == "mr")
+		*test = PRIME_TEST_MR_RANDOM;
+	else if (name == "fixed")
+		*test = PRIME_TEST_MR_FIXED;
+	else if (name == "bpsw")
+		*test = PRIME_TEST_BPSW;
+	else
+		return false;
+	return true;
+}
+
+/*
+ * Name of a test, as parsed by `prime_test_parse`.
+ */
+const char* prime_test_name(prime_test test)
+{
+	switch (test) {
+	case PRIME_TEST_MR_FIXED:
+		return "fixed";
+	case PRIME_TEST_BPSW:
+		return "bpsw";
+	default:
+		return "mr";
+	}
+}
+
+/*
+ * Number of Miller-Rabin rounds done by the selected test when asked for `rounds`: one base 2 round
+ * for BPSW, at most one per fixed base for PRIME_TEST_MR_FIXED.
+ */
+size_t prob_prime_mr_rounds(size_t rounds)
+{
+	switch (selected_test) {
+	case PRIME_TEST_BPSW:
+		return 1;
+	case PRIME_TEST_MR_FIXED:
+		return rounds < NB_FIXED_BASES ? rounds : NB_FIXED_BASES;
+	default:
+		return rounds;
+	}
+}
+
+/*
+ * Witness of the Miller-Rabin round `round` of n > 2^64 into `a`: random for PRIME_TEST_MR_RANDOM,
+ * the round-th fixed base otherwise (2 for BPSW).
+ */
+void prob_prime_witness(const mpz_class& n, size_t round, witness_rng* rng, mpz_class* a)
+{
+	if (selected_test == PRIME_TEST_MR_RANDOM)
+		draw_witness(n, rng, a);
+	else
+		mpz_set_ui(a->get_mpz_t(), fixed_bases[round]);
+}
+
+/*
+ * Miller-Rabin on an odd n > 3 of exactly N limbs, with FixedMontgomery<N> modular arithmetic
+ * instead of `mpz_powm`. Same algorithm as `miller_rabin_backend`.
+ */
+template <size_t N>
+static bool miller_rabin_fixed(const mpz_class& n, const size_t first, const size_t rounds, witness_rng* rng)
+{
+	const FixedMontgomery<N> m(mpz_limbs_read(n.get_mpz_t()));
+
+	// Write n-1 as d*2^s, n is odd so n-1 is n without its lowest bit
+	uint64_t n1[N];
+	FixedMontgomery<N>::copy(n1, m.modulus());
+	n1[0] &= ~1ULL;
+	size_t words = 0;
+	while (n1[words] == 0)
+		++words;
+	const size_t bits = __builtin_ctzll(n1[words]);
+	const size_t s = 64 * words + bits;
+	uint64_t d[N];
+	for (size_t i = 0; i < N; i++) {
+		uint64_t lo = i + words < N ? n1[i + words] : 0;
+		uint64_t hi = i + words + 1 < N ? n1[i + words + 1] : 0;
+		d[i] = bits == 0 ? lo : (lo >> bits) | (hi << (64 - bits));
+	}
+	size_t d_size = N;
+	while (d_size > 1 && d[d_size - 1] == 0)
+		--d_size;
+
+	for (size_t i = first; i < rounds; ++i) {
+		// Witness drawn straight into the limbs of x
+		uint64_t x[N] = {};
+		if (selected_test == PRIME_TEST_MR_RANDOM)
+			draw_witness_limbs(rng, m.modulus(), N, x);
+		else
+			x[0] = fixed_bases[i];
+		m.toMont(x, x);
+		m.pow(x, x, d, d_size);
+
+		if (FixedMontgomery<N>::equal(x, m.one()) || FixedMontgomery<N>::equal(x, m.minusOne()))
+			continue;
+
+		size_t r = 1;
+		for (; r < s; ++r) {
+			m.sqr(x, x);
+			if (FixedMontgomery<N>::equal(x, m.one())) {
+				// Definitely not a prime
+				return false;
+			}
+			if (FixedMontgomery<N>::equal(x, m.minusOne()))
+				break;
+		}
+
+		if (r == s) {
+			// Definitely not a prime
+			return false;
+		}
+	}
+
+	// Might be prime
+	return true;
+}
+
+/*
+ * Largest limb count dispatched to `miller_rabin_fixed`, up to FIXED_MONTGOMERY_MAX_LIMBS. Above 2
+ * limbs, `mpz_powm` (assembly basecase kernels) measured 10 to 15% faster than FixedMontgomery, and
+ * 50% faster at 16 limbs, so it is kept for the 100 digits values. Can be overridden at compile time.
+ */
+#ifndef FIXED_MONTGOMERY_DISPATCH_LIMBS
+	#define FIXED_MONTGOMERY_DISPATCH_LIMBS 2
+#endif
+
+typedef bool (*miller_rabin_fixed_fn)(const mpz_class&, const size_t, const size_t, witness_rng*);
+
+template <size_t... I>
+static constexpr std::array<miller_rabin_fixed_fn, sizeof...(I)> miller_rabin_fixed_table(std::index_sequence<I...>)
+{
+	return {{&miller_rabin_fixed<FIXED_MONTGOMERY_MIN_LIMBS + I>...}};
+}
+
+// miller_rabin_fixed<N> for every N handled by FixedMontgomery, indexed by N - FIXED_MONTGOMERY_MIN_LIMBS
+static constexpr std::array<miller_rabin_fixed_fn, FIXED_MONTGOMERY_MAX_LIMBS - FIXED_MONTGOMERY_MIN_LIMBS + 1> miller_rabin_fixed_by_size =
+	miller_rabin_fixed_table(std::make_index_sequence<FIXED_MONTGOMERY_MAX_LIMBS - FIXED_MONTGOMERY_MIN_LIMBS + 1>());
+
 /*
  * Ah, yes. The Miller-Rabin probabilistic prime testing algorithm. A fine
  * piece of work, it is.
  *
  * This implementation does not like negative numbers. Deal with it.
+ *
+ * Every intermediate value lives in the scratch buffers of the thread and is computed in place, so
+ * no heap allocation happens once the buffers are large enough for n.
+ *
+ * Runs the rounds [first, rounds), the witness of each round being chosen by `prob_prime_witness`.
  */
-static bool miller_rabin_backend(const mpz_class& n, const size_t rounds, gmp_randclass *rnd)
+static bool miller_rabin_backend(const mpz_class& n, const size_t first, const size_t rounds, witness_rng* rng)
 {
-	// Treat n==1, 2, 3 as a primes
-	if (n == 1 || n == 2 || n == 3)
+	// Treat n==2, 3 as primes
+	if (n == 2 || n == 3)
 		return true;
 
-	// Treat negative numbers in the frontend
-	if (n <= 0)
+	// Treat negative numbers in the frontend, 0 and 1 are not primes
+	if (n <= 1)
 		return false;
 
 	// Even numbers larger than two cannot be prime
-	if ((n & 1) == 0)
+	if (mpz_even_p(n.get_mpz_t()))
 		return false;
 
+	prob_prime_reserve(mpz_sizeinbase(n.get_mpz_t(), 2));
+
+	// Fixed width Montgomery arithmetic for small sizes, GMP otherwise
+	size_t limbs = mpz_size(n.get_mpz_t());
+	if (limbs >= FIXED_MONTGOMERY_MIN_LIMBS && limbs <= FIXED_MONTGOMERY_DISPATCH_LIMBS)
+		return miller_rabin_fixed_by_size[limbs - FIXED_MONTGOMERY_MIN_LIMBS](n, first, rounds, rng);
+
+	// In place operands, nn being n itself
+	mpz_srcptr nn = n.get_mpz_t();
+	mpz_ptr n1 = scratch.n1.get_mpz_t();
+	mpz_ptr d = scratch.d.get_mpz_t();
+	mpz_ptr a = scratch.a.get_mpz_t();
+	mpz_ptr x = scratch.x.get_mpz_t();
+
 	// Write n-1 as d*2^s by factoring powers of 2 from n-1
-	size_t s = 0;
-	{
-		mpz_class m = n - 1;
-		while ((m & 1) == 0) {
-			++s;
-			m >>= 1;
-		}
-	}
-	const mpz_class d = (n - 1) / (mpz_class(1) << s);
+	mpz_sub_ui(n1, nn, 1);
+	const size_t s = mpz_scan1(n1, 0);
+	mpz_tdiv_q_2exp(d, n1, s);
 
-	for (size_t i = 0; i < rounds; ++i) {
-		const mpz_class a = randint(2, n - 2, rnd);
-		mpz_class x = pow_mod(a, d, n);
+	for (size_t i = first; i < rounds; ++i) {
+		prob_prime_witness(n, i, rng, &scratch.a);
+		mpz_powm(x, a, d, nn);
 
-		if (x ==1 || x == (n - 1))
+		if (mpz_cmp_ui(x, 1) == 0 || mpz_cmp(x, n1) == 0)
 			continue;
 
 		for (size_t r = 0; r < (s-1); ++r) {
-			x = pow_mod(x, 2, n);
-			if (x == 1) {
+			mpz_mul(x, x, x);
+			mpz_mod(x, x, nn);
+			if (mpz_cmp_ui(x, 1) == 0) {
 				// Definitely not a prime
 				return false;
 			}
-			if (x == n - 1)
+			if (mpz_cmp(x, n1) == 0)
 				break;
 		}
 
-		if (x != (n - 1)) {
+		if (mpz_cmp(x, n1) != 0) {
 			// Definitely not a prime
 			return false;
 		}
@@ -103,8 +348,288 @@ static bool miller_rabin_backend(const mpz_class& n, const size_t rounds, gmp_ra
 }
 
 /*
- * The Miller-Rabin front end.
+ * Extra strong Lucas test of an odd n > 2^64 of exactly N limbs, with FixedMontgomery<N>
+ * arithmetic. Same algorithm as `strong_lucas_backend`, every value being kept in Montgomery form.
+ */
+template <size_t N>
+static bool strong_lucas_fixed(const mpz_class& n, const unsigned long P)
+{
+	const FixedMontgomery<N> m(mpz_limbs_read(n.get_mpz_t()));
+
+	// Write n+1 as d*2^s, d < n fits in N limbs
+	mpz_add_ui(scratch.n1.get_mpz_t(), n.get_mpz_t(), 1);
+	const size_t s = mpz_scan1(scratch.n1.get_mpz_t(), 0);
+	mpz_tdiv_q_2exp(scratch.d.get_mpz_t(), scratch.n1.get_mpz_t(), s);
+	uint64_t d[N] = {};
+	mpz_export(d, NULL, -1, sizeof(uint64_t), 0, 0, scratch.d.get_mpz_t());
+
+	// P and 2 in Montgomery form
+	uint64_t p[N] = {P};
+	uint64_t two[N] = {2};
+	m.toMont(p, p);
+	m.toMont(two, two);
+
+	// (V_k, V_k+1) from k = 1, ending at k = d
+	uint64_t v[N], w[N];
+	FixedMontgomery<N>::copy(v, p);
+	m.sqr(w, p);
+	m.subMod(w, w, two);
+	for (long b = (long) mpz_sizeinbase(scratch.d.get_mpz_t(), 2) - 2; b >= 0; b--) {
+		if ((d[b / 64] >> (b % 64)) & 1) {
+			m.mul(v, v, w);
+			m.subMod(v, v, p);
+			m.sqr(w, w);
+			m.subMod(w, w, two);
+		} else {
+			m.mul(w, v, w);
+			m.subMod(w, w, p);
+			m.sqr(v, v);
+			m.subMod(v, v, two);
+		}
+	}
+
+	// U_d = 0 (2 * V_d+1 = P * V_d) and V_d = +-2
+	uint64_t minus_two[N];
+	m.subMod(minus_two, m.modulus(), two);
+	if (FixedMontgomery<N>::equal(v, two) || FixedMontgomery<N>::equal(v, minus_two)) {
+		m.addMod(w, w, w);
+		m.mul(p, p, v);
+		if (FixedMontgomery<N>::equal(w, p))
+			return true;
+	}
+	// V_(d * 2^r) = 0 for some r < s - 1
+	for (size_t r = 0; r + 1 < s; ++r) {
+		if (FixedMontgomery<N>::isZero(v))
+			return true;
+		m.sqr(v, v);
+		m.subMod(v, v, two);
+	}
+	// Definitely not a prime
+	return false;
+}
+
+/*
+ * Largest limb count dispatched to `strong_lucas_fixed`. The Lucas test has no `mpz_powm` to lean
+ * on, its generic version pays a division per modular product. Can be overridden at compile time.
+ */
+#ifndef FIXED_MONTGOMERY_LUCAS_LIMBS
+	#define FIXED_MONTGOMERY_LUCAS_LIMBS FIXED_MONTGOMERY_MAX_LIMBS
+#endif
+
+typedef bool (*strong_lucas_fixed_fn)(const mpz_class&, const unsigned long);
+
+template <size_t... I>
+static constexpr std::array<strong_lucas_fixed_fn, sizeof...(I)> strong_lucas_fixed_table(std::index_sequence<I...>)
+{
+	return {{&strong_lucas_fixed<FIXED_MONTGOMERY_MIN_LIMBS + I>...}};
+}
+
+// strong_lucas_fixed<N> for every N handled by FixedMontgomery, indexed by N - FIXED_MONTGOMERY_MIN_LIMBS
+static constexpr std::array<strong_lucas_fixed_fn, FIXED_MONTGOMERY_MAX_LIMBS - FIXED_MONTGOMERY_MIN_LIMBS + 1> strong_lucas_fixed_by_size =
+	strong_lucas_fixed_table(std::make_index_sequence<FIXED_MONTGOMERY_MAX_LIMBS - FIXED_MONTGOMERY_MIN_LIMBS + 1>());
+
+/*
+ * Extra strong Lucas test of an odd n with the Lucas sequences of parameters P and Q = 1: with
+ * n + 1 = d * 2^s, n passes if U_d = 0 and V_d = +-2 mod n, or V_(d * 2^r) = 0 mod n for some
+ * r < s - 1. Only V is computed (V_2k = V_k^2 - 2, V_2k+1 = V_k * V_k+1 - P), U_d = 0 being checked
+ * as 2 * V_d+1 = P * V_d. Computed in place in the scratch buffers like `miller_rabin_backend`.
+ */
+static bool strong_lucas_backend(const mpz_class& n, const unsigned long P)
+{
+	mpz_srcptr nn = n.get_mpz_t();
+	mpz_ptr n1 = scratch.n1.get_mpz_t();
+	mpz_ptr d = scratch.d.get_mpz_t();
+	mpz_ptr v = scratch.v.get_mpz_t();
+	mpz_ptr w = scratch.w.get_mpz_t();
+	mpz_ptr t = scratch.x.get_mpz_t();
+
+	// Write n+1 as d*2^s
+	mpz_add_ui(n1, nn, 1);
+	const size_t s = mpz_scan1(n1, 0);
+	mpz_tdiv_q_2exp(d, n1, s);
+
+	// (V_k, V_k+1) from k = 1, ending at k = d
+	mpz_set_ui(v, P);
+	mpz_set_ui(w, P * P - 2);
+	for (long b = (long) mpz_sizeinbase(d, 2) - 2; b >= 0; b--) {
+		if (mpz_tstbit(d, b)) {
+			mpz_mul(v, v, w);
+			mpz_sub_ui(v, v, P);
+			mpz_mod(v, v, nn);
+			mpz_mul(w, w, w);
+			mpz_sub_ui(w, w, 2);
+			mpz_mod(w, w, nn);
+		} else {
+			mpz_mul(w, v, w);
+			mpz_sub_ui(w, w, P);
+			mpz_mod(w, w, nn);
+			mpz_mul(v, v, v);
+			mpz_sub_ui(v, v, 2);
+			mpz_mod(v, v, nn);
+		}
+	}
+
+	// U_d = 0 (2 * V_d+1 = P * V_d) and V_d = +-2
+	mpz_add_ui(t, v, 2);
+	if (mpz_cmp_ui(v, 2) == 0 || mpz_cmp(t, nn) == 0) {
+		mpz_mul_2exp(t, w, 1);
+		mpz_submul_ui(t, v, P);
+		mpz_mod(t, t, nn);
+		if (mpz_sgn(t) == 0)
+			return true;
+	}
+	// V_(d * 2^r) = 0 for some r < s - 1
+	for (size_t r = 0; r + 1 < s; ++r) {
+		if (mpz_sgn(v) == 0)
+			return true;
+		mpz_mul(v, v, v);
+		mpz_sub_ui(v, v, 2);
+		mpz_mod(v, v, nn);
+	}
+	// Definitely not a prime
+	return false;
+}
+
+/*
+ * Extra strong Lucas probable prime test of an odd n > 2^64 (Grantham's variant of the strong
+ * test, with Q = 1 so that only V needs to be computed, two modular products per bit): P is the
+ * first of 3, 4, 5, ... with (D/n) = -1 for D = P^2 - 4. Second half of the BPSW test.
+ */
+static bool strong_lucas(const mpz_class& n)
+{
+	// No D fits a square n, which is not a prime anyway
+	if (mpz_perfect_square_p(n.get_mpz_t()))
+		return false;
+	unsigned long P = 3;
+	for (;; P++) {
+		int j = mpz_si_kronecker(P * P - 4, n.get_mpz_t());
+		if (j == -1)
+			break;
+		// D shares a factor with n, which is larger than D
+		if (j == 0)
+			return false;
+	}
+
+	prob_prime_reserve(mpz_sizeinbase(n.get_mpz_t(), 2) + 1);
+	size_t limbs = mpz_size(n.get_mpz_t());
+	if (limbs >= FIXED_MONTGOMERY_MIN_LIMBS && limbs <= FIXED_MONTGOMERY_LUCAS_LIMBS)
+		return strong_lucas_fixed_by_size[limbs - FIXED_MONTGOMERY_MIN_LIMBS](n, P);
+	return strong_lucas_backend(n, P);
+}
+
+/*
+ * Montgomery multiplication modulo an odd 64 bits n, using 128 bits intermediate products.
+ * Values are kept in Montgomery form (x * 2^64 mod n).
+ */
+struct montgomery_u64 {
+	uint64_t n;
+	uint64_t n_inv; // n^-1 mod 2^64
+	uint64_t r2;    // 2^128 mod n
+
+	montgomery_u64(uint64_t modulus) : n(modulus) {
+		// Newton iteration, each step doubles the number of correct low bits (n is its own inverse mod 8)
+		n_inv = n;
+		for (int i = 0; i < 5; i++)
+			n_inv *= 2 - n * n_inv;
+		uint64_t r = -n % n;
+		r2 = (uint128_t) r * r % n;
+	}
+
+	// Returns t * 2^-64 mod n, for t < n * 2^64
+	inline uint64_t reduce(uint128_t t) const {
+		uint64_t m = (uint64_t) t * n_inv;
+		uint64_t hi = t >> 64;
+		uint64_t mn = ((uint128_t) m * n) >> 64;
+		return hi >= mn ? hi - mn : hi - mn + n;
+	}
+
+	inline uint64_t mul(uint64_t a, uint64_t b) const { return reduce((uint128_t) a * b); }
+	inline uint64_t to_mont(uint64_t a) const { return mul(a % n, r2); }
+	inline uint64_t one() const { return to_mont(1); }
+
+	uint64_t pow(uint64_t a, uint64_t x) const {
+		uint64_t r = one();
+		for (; x > 0; x >>= 1) {
+			if (x & 1)
+				r = mul(r, a);
+			a = mul(a, a);
+		}
+		return r;
+	}
+};
+
+/*
+ * Deterministic Miller-Rabin for 64 bits values. The set of bases below has been proven to give
+ * exact answers for every n < 2^64 (Jim Sinclair), so there is no need for random witnesses.
+ * Same conventions as `miller_rabin_backend` (0 and 1 are not primes).
+ */
+bool prob_prime_u64(uint64_t n)
+{
+	static const uint64_t bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+	if (n == 2 || n == 3)
+		return true;
+	if (n < 2 || (n & 1) == 0)
+		return false;
+
+	// Write n-1 as d*2^s
+	const int s = __builtin_ctzll(n - 1);
+	const uint64_t d = (n - 1) >> s;
+
+	const montgomery_u64 m(n);
+	const uint64_t one = m.one();
+	const uint64_t minus_one = n - one;
+
+	for (uint64_t base : bases) {
+		uint64_t a = m.to_mont(base);
+		// A base multiple of n says nothing about n
+		if (a == 0)
+			continue;
+		uint64_t x = m.pow(a, d);
+		if (x == one || x == minus_one)
+			continue;
+
+		int r = 1;
+		for (; r < s; ++r) {
+			x = m.mul(x, x);
+			if (x == one)
+				return false;
+			if (x == minus_one)
+				break;
+		}
+		if (r == s)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Returns true if n can be represented as an unsigned 64 bits integer.
  */
-bool prob_prime(const mpz_class& n, const size_t rounds, gmp_randclass *rnd) { 
-	return miller_rabin_backend(n > 0 ? n : -n, rounds, rnd); 
+bool fits_u64(const mpz_class& n)
+{
+	return mpz_sgn(n.get_mpz_t()) >= 0 && mpz_sizeinbase(n.get_mpz_t(), 2) <= 64;
+}
+
+/*
+ * The primality test front end, running the test selected by `prob_prime_set_test`. Values fitting
+ * in 64 bits go through the exact deterministic test whatever the selected test.
+ */
+bool prob_prime(const mpz_class& n, const size_t rounds, witness_rng* rng) { 
+	return prob_prime_from(n, 0, rounds, rng);
+}
+
+/*
+ * `prob_prime` without the Miller-Rabin rounds before `first`, already passed by n (see
+ * `prob_prime_batch`). The Lucas test of BPSW is always run.
+ */
+bool prob_prime_from(const mpz_class& n, const size_t first, const size_t rounds, witness_rng* rng)
+{
+	if (mpz_cmpabs_ui(n.get_mpz_t(), ULONG_MAX) <= 0)
+		return prob_prime_u64(mpz_get_ui(n.get_mpz_t()));
+	if (mpz_sgn(n.get_mpz_t()) < 0)
+		return prob_prime_from(-n, first, rounds, rng);
+	if (!miller_rabin_backend(n, first, prob_prime_mr_rounds(rounds), rng))
+		return false;
+	return selected_test != PRIME_TEST_BPSW || strong_lucas(n);
 }
\ No newline at end of file
@@ -0,0 +1,231 @@
+/*
+ * Streaming computation in stages connected by bounded queues, see pipeline.hpp.
+ */
+
+#include <algorithm>
+
+#include "checkpoint.hpp"
+#include "pipeline.hpp"
+#include "scan.hpp"
+
+Pipeline::Pipeline(IntervalReader* reader, int nb_scanners, int rounds, const std::vector<uint32_t>* sieve_primes)
+	: mReader(reader)
+	, mRounds(rounds)
+	, mSievePrimes(sieve_primes)
+	, mIntervals(PIPELINE_INTERVAL_DEPTH)
+	, mTasks(PIPELINE_TASK_DEPTH * (nb_scanners > 0 ? nb_scanners : 1))
+	, mSlots(PIPELINE_WINDOW * (nb_scanners > 0 ? nb_scanners : 1))
+	, mWritten(0)
+	, mTaskCount(0)
+	, mMerged(false)
+	, mPeak(0)
+	, mPrimes(0)
+	, mResumed(false)
+	, mStats{}
+	, mMalformed(false) {
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mReady, NULL);
+	pthread_cond_init(&mFree, NULL);
+	for (pipeline_slot& slot : mSlots)
+		slot.done = false;
+}
+
+Pipeline::~Pipeline() {
+	pthread_cond_destroy(&mFree);
+	pthread_cond_destroy(&mReady);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void Pipeline::resume_from(const mpz_class& value) {
+	mResume = value;
+	mResumed = true;
+}
+
+void Pipeline::read() {
+	std::pair<mpz_class, mpz_class> interval;
+	while (mReader->next(0, &interval.first, &interval.second)) {
+		mIntervals.push(std::move(interval));
+	}
+	mMalformed = !mReader->ok(0);
+	mIntervals.close();
+}
+
+/*
+* Number the task and queue it for the scanners, `task` is left empty.
+*/
+void Pipeline::hand_out(pipeline_task* task) {
+	task->seq = mTaskCount++;
+	mTasks.push(std::move(*task));
+	task->bounds.clear();
+}
+
+void Pipeline::merge() {
+	// Intervals can only be merged as they come if they come in order, otherwise they are all
+	// gathered and sorted first
+	const bool sorted = mReader->sorted();
+	std::vector<std::pair<mpz_class, mpz_class>> gathered;
+	pipeline_task task;
+	// Values of `task`
+	uint64_t task_values = 0;
+	// Merged interval [start, covered) being handed out, empty until the first interval
+	mpz_class start, covered;
+	bool started = false;
+	// Values done by a previous run are handled as a merged interval ending at the resume point
+	if (mResumed) {
+		start = mResume;
+		covered = mResume;
+		started = true;
+	}
+	mpz_class from, length;
+	auto add = [&](const mpz_class& lower, const mpz_class& upper) {
+		if (!started || covered < lower) {
+			// No overlap with the merged interval, start a new one
+			start = lower;
+			covered = lower;
+			started = true;
+		}
+		// Only the part past the merged interval is new
+		from = covered;
+		while (from < upper) {
+			length = upper - from;
+			uint64_t room = PIPELINE_TASK_SIZE - task_values;
+			uint64_t n = mpz_cmp_ui(length.get_mpz_t(), room) > 0 ? room : mpz_get_ui(length.get_mpz_t());
+			task.bounds.push_back(from);
+			from += n;
+			task.bounds.push_back(from);
+			task_values += n;
+			if (task_values == PIPELINE_TASK_SIZE || task.bounds.size() == 2 * PIPELINE_TASK_RANGES) {
+				hand_out(&task);
+				task_values = 0;
+			}
+		}
+		if (covered < from)
+			covered = from;
+	};
+
+	std::pair<mpz_class, mpz_class> interval;
+	while (mIntervals.pop(&interval)) {
+		if (sorted)
+			add(interval.first, interval.second);
+		else
+			gathered.push_back(std::move(interval));
+	}
+	std::stable_sort(gathered.begin(), gathered.end(), [](const std::pair<mpz_class, mpz_class>& a, const std::pair<mpz_class, mpz_class>& b) {
+		return a.first < b.first;
+	});
+	for (const std::pair<mpz_class, mpz_class>& i : gathered)
+		add(i.first, i.second);
+	if (!task.bounds.empty())
+		hand_out(&task);
+
+	pthread_mutex_lock(&mMutex);
+	mMerged = true;
+	pthread_cond_signal(&mReady);
+	pthread_mutex_unlock(&mMutex);
+	mTasks.close();
+}
+
+void Pipeline::scan(witness_rng* rng) {
+	pipeline_task task;
+	sieve_stats local_stats{};
+	mpz_class offset;
+	while (mTasks.pop(&task)) {
+		// Wait for the slot of the task to be written, so the reorder buffer never grows
+		pipeline_slot& slot = mSlots[task.seq % mSlots.size()];
+		pthread_mutex_lock(&mMutex);
+		while (task.seq >= mWritten + mSlots.size())
+			pthread_cond_wait(&mFree, &mMutex);
+		if (task.seq + 1 - mWritten > mPeak)
+			mPeak = task.seq + 1 - mWritten;
+		pthread_mutex_unlock(&mMutex);
+
+		// The slot keeps the buffers of its previous task, so they are reused
+		std::swap(slot.task, task);
+		slot.offsets.clear();
+		slot.ends.clear();
+		const std::vector<mpz_class>& bounds = slot.task.bounds;
+		for (size_t i = 0; i < bounds.size(); i += 2) {
+			const mpz_class& base = bounds[i];
+			scan_interval(bounds[i], bounds[i + 1], mRounds, rng, mSievePrimes, &local_stats, [&](const mpz_class& prime) {
+				mpz_sub(offset.get_mpz_t(), prime.get_mpz_t(), base.get_mpz_t());
+				slot.offsets.push_back(mpz_get_ui(offset.get_mpz_t()));
+			});
+			slot.ends.push_back(slot.offsets.size());
+		}
+
+		pthread_mutex_lock(&mMutex);
+		slot.done = true;
+		pthread_cond_signal(&mReady);
+		pthread_mutex_unlock(&mMutex);
+	}
+
+	pthread_mutex_lock(&mMutex);
+	mStats.candidates += local_stats.candidates;
+	mStats.survivors += local_stats.survivors;
+	pthread_mutex_unlock(&mMutex);
+}
+
+/*
+* Body of the writer stages: call `on_slot(slot)` on the slot of each task, in order, as soon as it
+* is scanned.
+*/
+template <typename F>
+void Pipeline::drain(F on_slot) {
+	for (uint64_t seq = 0;; seq++) {
+		pipeline_slot& slot = mSlots[seq % mSlots.size()];
+		pthread_mutex_lock(&mMutex);
+		while (!slot.done && !(mMerged && seq == mTaskCount))
+			pthread_cond_wait(&mReady, &mMutex);
+		bool end = !slot.done;
+		pthread_mutex_unlock(&mMutex);
+		if (end)
+			break;
+
+		// Scanners don't touch a done slot, it is read without the lock
+		on_slot(slot);
+		mPrimes += slot.offsets.size();
+
+		pthread_mutex_lock(&mMutex);
+		slot.done = false;
+		mWritten = seq + 1;
+		pthread_cond_broadcast(&mFree);
+		pthread_mutex_unlock(&mMutex);
+	}
+}
+
+void Pipeline::write(std::ostream& out, char separator) {
+	mpz_class value;
+	drain([&](const pipeline_slot& slot) {
+		const std::vector<mpz_class>& bounds = slot.task.bounds;
+		size_t first = 0;
+		for (size_t r = 0; r < slot.ends.size(); r++) {
+			for (size_t i = first; i < slot.ends[r]; i++) {
+				mpz_add_ui(value.get_mpz_t(), bounds[2 * r].get_mpz_t(), slot.offsets[i]);
+				out << value << separator;
+			}
+			first = slot.ends[r];
+		}
+	});
+	out.flush();
+}
+
+void Pipeline::write(PrimeWriter* out, Checkpoint* checkpoint) {
+	// Upper bound of the last task written
+	mpz_class high_water;
+	bool written = false;
+	drain([&](const pipeline_slot& slot) {
+		size_t first = 0;
+		for (size_t r = 0; r < slot.ends.size(); r++) {
+			out->run(slot.task.bounds[2 * r], slot.offsets.data() + first, slot.ends[r] - first);
+			first = slot.ends[r];
+		}
+		if (checkpoint != NULL) {
+			high_water = slot.task.bounds.back();
+			written = true;
+			checkpoint->save(high_water, false);
+		}
+	});
+	out->flush();
+	if (checkpoint != NULL && written)
+		checkpoint->save(high_water, true);
+}
@@ -0,0 +1,34 @@
+/*
+ * Compact list of ascending likely primes, see prime-list.hpp.
+ */
+
+#include "prime-list.hpp"
+
+void PrimeList::push(const mpz_class& prime) {
+	if (!mBases.empty()) {
+		mpz_sub(mScratch.get_mpz_t(), prime.get_mpz_t(), mBases.back().get_mpz_t());
+		if (mpz_sgn(mScratch.get_mpz_t()) >= 0 && mpz_cmp_ui(mScratch.get_mpz_t(), UINT32_MAX) <= 0) {
+			mOffsets.push_back(mpz_get_ui(mScratch.get_mpz_t()));
+			mEnds.back()++;
+			return;
+		}
+	}
+	mBases.push_back(prime);
+	mEnds.push_back(mOffsets.size() + 1);
+	mOffsets.push_back(0);
+}
+
+void PrimeList::append(const PrimeList* other) {
+	size_t shift = mOffsets.size();
+	mBases.insert(mBases.end(), other->mBases.begin(), other->mBases.end());
+	for (size_t end : other->mEnds)
+		mEnds.push_back(shift + end);
+	mOffsets.insert(mOffsets.end(), other->mOffsets.begin(), other->mOffsets.end());
+}
+
+size_t PrimeList::memory() const {
+	size_t bytes = sizeof(*this) + mBases.capacity() * sizeof(mpz_class) + mEnds.capacity() * sizeof(size_t) + mOffsets.capacity() * sizeof(uint32_t);
+	for (const mpz_class& base : mBases)
+		bytes += base.get_mpz_t()->_mp_alloc * sizeof(mp_limb_t);
+	return bytes;
+}
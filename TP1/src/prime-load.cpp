@@ -0,0 +1,181 @@
+/*!
+ * \file prime-load.cpp
+ * \brief Load generator of the prime query server (see query-server.hpp): clients send the
+ * intervals of a file as a batch again and again, then the throughput and the latency percentiles
+ * of the batches are printed.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+* Data of a client thread.
+* socket : path of the socket of the server.
+* batch : request sent, ended by an empty line.
+* requests : number of batches to send.
+* latencies : seconds between the request and the end of the reply of each batch, filled by the
+* client.
+* errors : number of batches which failed, the server replied an error or the connection is lost.
+* reply : reply of the first batch, kept to be printed.
+*/
+struct load_client {
+	const std::string * socket;
+	const std::string * batch;
+	int requests;
+	std::vector<double> latencies;
+	int errors;
+	std::string reply;
+};
+
+/*
+* Connect to the server at `path`.
+* return : socket of the connection, -1 if the server can't be reached.
+*/
+int load_connect(const std::string& path) {
+	struct sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+		return -1;
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+* Send the batch `requests` times on a connection of its own, each batch waiting for the reply of
+* the previous one.
+* data : `load_client` pointer.
+*/
+void * load_run(void * data) {
+	load_client * client = (load_client *) data;
+	int fd = load_connect(*client->socket);
+	std::vector<char> buffer(1 << 16);
+	for (int i = 0; i < client->requests; i++) {
+		if (fd < 0) {
+			client->errors++;
+			continue;
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool ok = send(fd, client->batch->data(), client->batch->size(), MSG_NOSIGNAL) == (ssize_t) client->batch->size();
+		// The reply ends with its only new line
+		bool first = true;
+		bool error = false;
+		while (ok) {
+			ssize_t size = read(fd, buffer.data(), buffer.size());
+			if (size <= 0) {
+				ok = false;
+				break;
+			}
+			if (first && strncmp(buffer.data(), "error:", std::min<size_t>(size, 6)) == 0)
+				error = true;
+			first = false;
+			if (i == 0)
+				client->reply.append(buffer.data(), size);
+			if (buffer[size - 1] == '\n')
+				break;
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (!ok || error) {
+			client->errors++;
+			if (!ok) {
+				close(fd);
+				fd = -1;
+			}
+			continue;
+		}
+		client->latencies.push_back(elapsed.count());
+	}
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+/*
+* Value below which `rank` of the sorted `values` are, `rank` in [0, 1].
+*/
+double percentile(const std::vector<double>& values, double rank) {
+	if (values.empty())
+		return 0;
+	size_t index = (size_t) (rank * (values.size() - 1) + 0.5);
+	return values[index];
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "usage: prime-load <socket> <filepath> [clients] [requests] [--print]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::string socket = argv[1];
+	int nb_clients = 1;
+	int requests = 100;
+	// Print the reply of the first batch on the standard output
+	bool print = false;
+	int position = 0;
+	for (int i = 3; i < argc; i++) {
+		if (std::string(argv[i]) == "--print")
+			print = true;
+		else if (position++ == 0)
+			nb_clients = atoi(argv[i]);
+		else
+			requests = atoi(argv[i]);
+	}
+	std::ifstream file(argv[2]);
+	if (!file.is_open()) {
+		std::cerr << "error: can\'t open file at : " << argv[2] << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::stringstream content;
+	content << file.rdbuf();
+	// Empty lines would end the batch early
+	std::string batch;
+	std::string line;
+	while (getline(content, line)) {
+		if (line.find_first_not_of(" \t\r") != std::string::npos)
+			batch += line + "\n";
+	}
+	batch += "\n";
+
+	std::vector<load_client> clients(nb_clients);
+	std::vector<pthread_t> threads(nb_clients);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < nb_clients; i++) {
+		clients[i].socket = &socket;
+		clients[i].batch = &batch;
+		clients[i].requests = requests;
+		clients[i].errors = 0;
+		pthread_create(&threads[i], NULL, &load_run, &clients[i]);
+	}
+	for (int i = 0; i < nb_clients; i++)
+		pthread_join(threads[i], NULL);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::vector<double> latencies;
+	int errors = 0;
+	for (const load_client& client : clients) {
+		latencies.insert(latencies.end(), client.latencies.begin(), client.latencies.end());
+		errors += client.errors;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	if (print && nb_clients > 0)
+		std::cout << clients[0].reply;
+	std::cerr << "requests: " << latencies.size() << " served, " << errors << " failed in " << elapsed.count() << " s, "
+		<< latencies.size() / elapsed.count() << " requests/s" << std::endl;
+	std::cerr << "latency: p50 " << percentile(latencies, 0.5) * 1e3 << " ms, p90 " << percentile(latencies, 0.9) * 1e3
+		<< " ms, p99 " << percentile(latencies, 0.99) * 1e3 << " ms, max " << percentile(latencies, 1) * 1e3 << " ms" << std::endl;
+	return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
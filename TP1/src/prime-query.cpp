@@ -0,0 +1,197 @@
+/*
+ * Queries on the primes of intervals, see prime-query.hpp.
+ */
+
+#include <atomic>
+#include <cmath>
+
+#include <pthread.h>
+
+#include "prime-list.hpp"
+#include "prime-query.hpp"
+#include "scan.hpp"
+#include "steal-scheduler.hpp"
+
+// Windows which found no prime are doubled, up to 2^QUERY_GROWTH_MAX times their expected size
+#define QUERY_GROWTH_MAX 32
+
+// To add the sieve counters of a worker to the counters of the query
+static pthread_mutex_t query_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void query_stats_add(sieve_stats * stats, const sieve_stats * worker_stats) {
+	pthread_mutex_lock(&query_mutex);
+	stats->candidates += worker_stats->candidates;
+	stats->survivors += worker_stats->survivors;
+	pthread_mutex_unlock(&query_mutex);
+}
+
+uint64_t count_primes(ThreadPool * pool, const std::vector<mpz_class> * intervals, int rounds, const std::vector<uint32_t> * sieve_primes, const cost_model * model, sieve_stats * stats) {
+	StealScheduler scheduler(pool->size());
+	for (size_t i = 0; i < intervals->size(); i += 2)
+		scheduler.add_interval(intervals->at(i), intervals->at(i + 1));
+	if (model != NULL)
+		scheduler.plan(model);
+	// Counter of each worker, written once it is done
+	std::vector<uint64_t> counts(pool->size(), 0);
+	pool->run([&](pool_worker * worker) {
+		uint64_t count = 0;
+		sieve_stats worker_stats{};
+		steal_range piece;
+		while (scheduler.next(worker->index, &piece)) {
+			const mpz_class& base = scheduler.base(piece.slice);
+			mpz_add_ui(worker->from.get_mpz_t(), base.get_mpz_t(), piece.begin);
+			mpz_add_ui(worker->to.get_mpz_t(), base.get_mpz_t(), piece.end);
+			scan_interval(worker->from, worker->to, rounds, &worker->rng, sieve_primes, &worker_stats, [&](const mpz_class&) {
+				count++;
+			});
+		}
+		counts[worker->index] = count;
+		query_stats_add(stats, &worker_stats);
+	});
+	uint64_t total = 0;
+	for (uint64_t count : counts)
+		total += count;
+	return total;
+}
+
+/*
+* Number of values of a window expected to hold `missing` primes from `value`, times 2^`growth`.
+*/
+static mpz_class window_length(const mpz_class& value, uint64_t missing, int growth) {
+	// Mean gap between two primes around `value`, ln(value)
+	double gap = std::max(1.0, mpz_sizeinbase(value.get_mpz_t(), 2) * M_LN2);
+	double length = std::max((double) QUERY_WINDOW_MIN, missing * gap * QUERY_WINDOW_MARGIN);
+	mpz_class result(length);
+	result <<= growth;
+	return result;
+}
+
+/*
+* Number of values of the pieces of a window of `length` values.
+*/
+static mpz_class window_piece(ThreadPool * pool, const mpz_class& length) {
+	mpz_class piece = length / (pool->size() * QUERY_PIECES_PER_WORKER);
+	if (piece < QUERY_PIECE_MIN)
+		piece = QUERY_PIECE_MIN;
+	return piece;
+}
+
+/*
+* Cut [from, to) into pieces of `piece` values, appended to `pieces` ([from1, to1, ...]).
+*/
+static void window_cut(const mpz_class& from, const mpz_class& to, const mpz_class& piece, std::vector<mpz_class> * pieces) {
+	mpz_class begin = from;
+	while (begin < to) {
+		mpz_class end = begin + piece;
+		if (end > to)
+			end = to;
+		pieces->push_back(begin);
+		pieces->push_back(end);
+		begin = end;
+	}
+}
+
+/*
+* Find the likely primes of the pieces [from1, to1, ...] of a window, each worker taking the next
+* piece when it is done, the primes of the piece `i` going to `primes[i]`.
+*/
+static void window_scan(ThreadPool * pool, const std::vector<mpz_class>& pieces, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, std::vector<PrimeList> * primes) {
+	size_t count = pieces.size() / 2;
+	primes->assign(count, PrimeList());
+	std::atomic<size_t> next(0);
+	pool->run([&](pool_worker * worker) {
+		sieve_stats worker_stats{};
+		for (size_t i = next++; i < count; i = next++) {
+			PrimeList * out = &primes->at(i);
+			scan_interval(pieces[2 * i], pieces[2 * i + 1], rounds, &worker->rng, sieve_primes, &worker_stats, [&](const mpz_class& prime) {
+				out->push(prime);
+			});
+		}
+		query_stats_add(stats, &worker_stats);
+	});
+}
+
+uint64_t first_primes(ThreadPool * pool, const std::vector<mpz_class> * intervals, uint64_t k, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, const std::function<void(const mpz_class&)>& on_prime) {
+	uint64_t found = 0;
+	int growth = 0;
+	// Interval of the next window, and first value of the next window
+	size_t interval = 0;
+	mpz_class position = intervals->empty() ? mpz_class(0) : intervals->at(0);
+	std::vector<mpz_class> pieces;
+	std::vector<PrimeList> primes;
+	while (found < k && interval < intervals->size()) {
+		// The window goes on over the next intervals until it has its length
+		mpz_class left = window_length(position, k - found, growth);
+		mpz_class piece = window_piece(pool, left);
+		pieces.clear();
+		while (left > 0 && interval < intervals->size()) {
+			const mpz_class& end = intervals->at(interval + 1);
+			if (position < end) {
+				mpz_class to = position + left;
+				if (to > end)
+					to = end;
+				window_cut(position, to, piece, &pieces);
+				left -= to - position;
+				position = to;
+			}
+			if (position >= end) {
+				interval += 2;
+				if (interval < intervals->size())
+					position = intervals->at(interval);
+			}
+		}
+		window_scan(pool, pieces, rounds, sieve_primes, stats, &primes);
+		uint64_t before = found;
+		for (const PrimeList& list : primes) {
+			for (PrimeList::iterator it = list.begin(); it != list.end() && found < k; ++it) {
+				on_prime(*it);
+				found++;
+			}
+		}
+		if (found > before)
+			growth = 0;
+		else if (growth < QUERY_GROWTH_MAX)
+			growth++;
+	}
+	return found;
+}
+
+void next_prime(ThreadPool * pool, const mpz_class& n, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, mpz_class * prime) {
+	mpz_class from = n + 1;
+	if (from < 2)
+		from = 2;
+	// There is always a prime in (from, 2 * from) (Bertrand's postulate)
+	std::vector<mpz_class> bounds = {from, 2 * from + 1};
+	first_primes(pool, &bounds, 1, rounds, sieve_primes, stats, [&](const mpz_class& found) {
+		*prime = found;
+	});
+}
+
+bool prev_prime(ThreadPool * pool, const mpz_class& n, int rounds, const std::vector<uint32_t> * sieve_primes, sieve_stats * stats, mpz_class * prime) {
+	int growth = 0;
+	// Windows go down from `n`, the last one ending at 2
+	mpz_class high = n;
+	std::vector<mpz_class> pieces;
+	std::vector<PrimeList> primes;
+	while (high > 2) {
+		mpz_class length = window_length(high, 1, growth);
+		mpz_class low = high - length;
+		if (low < 2)
+			low = 2;
+		pieces.clear();
+		window_cut(low, high, window_piece(pool, length), &pieces);
+		window_scan(pool, pieces, rounds, sieve_primes, stats, &primes);
+		// The greatest prime is the last one of the last piece holding primes
+		for (size_t i = primes.size(); i-- > 0;) {
+			if (primes[i].size() == 0)
+				continue;
+			for (const mpz_class& found : primes[i])
+				*prime = found;
+			return true;
+		}
+		high = low;
+		if (growth < QUERY_GROWTH_MAX)
+			growth++;
+	}
+	return false;
+}
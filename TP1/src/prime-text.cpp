@@ -0,0 +1,203 @@
+/*
+ * Threaded decimal output of the primes, see prime-text.hpp.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <string>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "prime-text.hpp"
+
+/*
+* Primes of a run lying in the same interval, written from the same base.
+* begin, end : indexes of the primes in the list, [begin, end).
+* run : run of the primes, whose first prime is at `run_begin`.
+* shift : value the offsets of the run are added to, the base of the run minus the lower bound of
+* the interval with --offsets.
+* lower : lower bound of the interval, NULL when the primes are written in full.
+* first, last : true for the first (last) span of its interval.
+*/
+struct text_span {
+	size_t begin;
+	size_t end;
+	size_t run;
+	size_t run_begin;
+	mpz_class shift;
+	const mpz_class * lower;
+	bool first;
+	bool last;
+};
+
+/*
+* Cut the runs of `primes` into spans, at the bounds of the `intervals` if not NULL.
+*/
+static std::vector<text_span> text_spans(const PrimeList * primes, const std::vector<mpz_class> * intervals) {
+	std::vector<text_span> spans;
+	size_t index = 0;
+	size_t interval = 0;
+	mpz_class value;
+	for (size_t run = 0; run < primes->runs(); run++) {
+		const mpz_class& base = primes->run_base(run);
+		const uint32_t * offsets = primes->run_offsets(run);
+		size_t count = primes->run_size(run);
+		if (intervals == NULL) {
+			spans.push_back({index, index + count, run, index, base, NULL, false, false});
+			index += count;
+			continue;
+		}
+		// Primes of the run up to the end of the interval of the first one, for each interval
+		for (size_t i = 0; i < count;) {
+			mpz_add_ui(value.get_mpz_t(), base.get_mpz_t(), offsets[i]);
+			while (interval + 3 < intervals->size() && value >= intervals->at(interval + 1))
+				interval += 2;
+			const mpz_class& lower = intervals->at(interval);
+			mpz_class limit = intervals->at(interval + 1) - base;
+			size_t j = count;
+			if (mpz_sgn(limit.get_mpz_t()) <= 0)
+				j = i;
+			else if (mpz_cmp_ui(limit.get_mpz_t(), UINT32_MAX) <= 0)
+				j = std::lower_bound(offsets + i, offsets + count, (uint32_t) limit.get_ui()) - offsets;
+			// A prime out of the intervals is kept with the last one before it
+			if (j == i)
+				j = i + 1;
+			bool first = spans.empty() || spans.back().lower != &lower;
+			if (first && !spans.empty())
+				spans.back().last = true;
+			spans.push_back({index + i, index + j, run, index, base - lower, &lower, first, false});
+			i = j;
+		}
+		index += count;
+	}
+	if (intervals != NULL && !spans.empty())
+		spans.back().last = true;
+	return spans;
+}
+
+/*
+* Add `delta` to the decimal value `digits`.
+*/
+static void decimal_add(std::string * digits, uint64_t delta) {
+	for (size_t i = digits->size(); delta > 0;) {
+		if (i == 0) {
+			digits->insert(digits->begin(), '0');
+			i = 1;
+		}
+		i--;
+		uint64_t digit = (*digits)[i] - '0' + delta;
+		(*digits)[i] = '0' + digit % 10;
+		delta = digit / 10;
+	}
+}
+
+/*
+* Set `digits` to the decimal value of `value`.
+*/
+static void decimal_set(std::string * digits, const mpz_class& value) {
+	digits->resize(mpz_sizeinbase(value.get_mpz_t(), 10) + 2);
+	mpz_get_str(&(*digits)[0], 10, value.get_mpz_t());
+	digits->resize(digits->find('\0'));
+}
+
+/*
+* Append the text of the primes [begin, end) of the list to `text`.
+* scratch, digits : values of the worker, reused from one block to the next.
+*/
+static void text_block(const PrimeList * primes, const std::vector<text_span>& spans, size_t begin, size_t end, mpz_class * scratch, std::string * digits, std::string * text) {
+	// First span holding a prime of the block
+	size_t s = std::upper_bound(spans.begin(), spans.end(), begin, [](size_t index, const text_span& span) {
+		return index < span.end;
+	}) - spans.begin();
+	for (; s < spans.size() && spans[s].begin < end; s++) {
+		const text_span& span = spans[s];
+		const uint32_t * offsets = primes->run_offsets(span.run);
+		if (span.first && span.begin >= begin) {
+			decimal_set(digits, *span.lower);
+			*text += *digits;
+			*text += ':';
+		}
+		size_t from = std::max(begin, span.begin);
+		size_t to = std::min(end, span.end);
+		mpz_add_ui(scratch->get_mpz_t(), span.shift.get_mpz_t(), offsets[from - span.run_begin]);
+		decimal_set(digits, *scratch);
+		for (size_t i = from; i < to; i++) {
+			if (i > from)
+				decimal_add(digits, offsets[i - span.run_begin] - offsets[i - 1 - span.run_begin]);
+			if (span.lower != NULL) {
+				*text += ' ';
+				*text += *digits;
+			} else {
+				*text += *digits;
+				*text += ' ';
+			}
+		}
+		if (span.last && to == span.end)
+			*text += '\n';
+	}
+}
+
+/*
+* Write the `size` bytes of `data` to `fd`.
+* return : false if the output can't be written.
+*/
+static bool write_all(int fd, const char * data, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool prime_text_write(ThreadPool * pool, const PrimeList * primes, const std::vector<mpz_class> * intervals, int fd) {
+	std::vector<text_span> spans = text_spans(primes, intervals);
+	size_t blocks = (primes->size() + PRIME_TEXT_BLOCK - 1) / PRIME_TEXT_BLOCK;
+	// Bytes of a block, from the greatest prime or offset
+	size_t reserve = 0;
+	if (!spans.empty()) {
+		const text_span& span = spans.back();
+		mpz_class greatest = span.shift + primes->run_offsets(span.run)[span.end - 1 - span.run_begin];
+		reserve = PRIME_TEXT_BLOCK * (mpz_sizeinbase(greatest.get_mpz_t(), 10) + 1);
+	}
+	std::atomic<size_t> next(0);
+	std::atomic<bool> ok(true);
+	// Next block to write, blocks are written in order
+	size_t turn = 0;
+	pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_cond_t written = PTHREAD_COND_INITIALIZER;
+	pool->run([&](pool_worker * worker) {
+		// Text of the block of the worker, allocated once
+		std::string text;
+		text.reserve(reserve);
+		std::string digits;
+		for (size_t block = next++; block < blocks; block = next++) {
+			text.clear();
+			size_t begin = block * PRIME_TEXT_BLOCK;
+			text_block(primes, spans, begin, std::min(primes->size(), begin + PRIME_TEXT_BLOCK), &worker->from, &digits, &text);
+			// Blocks are taken in ascending order, the previous one is already taken by another worker
+			pthread_mutex_lock(&mutex);
+			while (turn != block)
+				pthread_cond_wait(&written, &mutex);
+			pthread_mutex_unlock(&mutex);
+			if (ok && !write_all(fd, text.data(), text.size()))
+				ok = false;
+			pthread_mutex_lock(&mutex);
+			turn++;
+			pthread_cond_broadcast(&written);
+			pthread_mutex_unlock(&mutex);
+		}
+	});
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&written);
+	// The full values end with a new line, even without any prime
+	if (ok && intervals == NULL)
+		ok = write_all(fd, "\n", 1);
+	return ok;
+}
@@ -0,0 +1,121 @@
+/*
+ * Prime constellations, see prime-tuple.hpp.
+ */
+
+#include "prime-tuple.hpp"
+
+// Constellations known by `prime_tuple_find`
+static const prime_tuple prime_tuples[] = {
+	{"twin", 2, {1, 1}, {0, 2}},
+	{"cousin", 2, {1, 1}, {0, 4}},
+	// p is smaller than 2p + 1, so it is the cheapest to test
+	{"sophie", 2, {1, 2}, {0, 1}},
+};
+
+/*
+* Returns the constellation named `name` ("twin", "cousin" or "sophie"), NULL if there is none.
+*/
+const prime_tuple * prime_tuple_find(const std::string& name) {
+	for (const prime_tuple& tuple : prime_tuples) {
+		if (name == tuple.name)
+			return &tuple;
+	}
+	return NULL;
+}
+
+/*
+* Returns `a^-1 mod q`, `q` being prime and not dividing `a`.
+*/
+static uint64_t inverse_mod(uint64_t a, uint64_t q) {
+	// Fermat: a^(q - 2) = a^-1 mod q
+	uint64_t result = 1;
+	a %= q;
+	for (uint64_t e = q - 2; e > 0; e >>= 1) {
+		if (e & 1)
+			result = result * a % q;
+		a = a * a % q;
+	}
+	return result;
+}
+
+/*
+* Returns the joint sieve of `tuple` with the small `primes`: for each small prime q and member
+* a * p + b, the residue of p mod q making the member a multiple of q, -b / a mod q.
+*
+* result pointer is property of caller
+*/
+tuple_sieve * tuple_sieve_new(const prime_tuple * tuple, const std::vector<uint32_t> * primes) {
+	tuple_sieve * sieve = new tuple_sieve();
+	sieve->tuple = tuple;
+	sieve->primes = *primes;
+	sieve->targets.assign(primes->size() * TUPLE_MAX_MEMBERS, TUPLE_NO_TARGET);
+	for (size_t i = 0; i < primes->size(); i++) {
+		uint64_t q = primes->at(i);
+		uint32_t * targets = &sieve->targets[i * TUPLE_MAX_MEMBERS];
+		for (int m = 0; m < tuple->members; m++) {
+			// q | a: the member is b mod q for every p, never 0 for the constellations above
+			if (tuple->a[m] % q == 0)
+				continue;
+			uint64_t target = (q - tuple->b[m] % q) % q * inverse_mod(tuple->a[m], q) % q;
+			bool struck = false;
+			for (int n = 0; n < m; n++)
+				struck |= targets[n] == target;
+			if (!struck)
+				targets[m] = target;
+		}
+	}
+	return sieve; // Property of caller
+}
+
+/*
+* Strike out of `seg->bits` every p with a member multiple of a small prime. `residue(q)` returns
+* `base mod q`. A member equal to the small prime itself is kept (3 of the twins 3, 5), which can
+* only happen when the segment starts at `small_base` up to q (UINT64_MAX if the base does not
+* fit in 64 bits).
+*/
+template <typename R>
+static void tuple_segment_strike(sieve_segment * seg, uint64_t small_base, const tuple_sieve * sieve, sieve_stats * stats, R residue) {
+	const prime_tuple * tuple = sieve->tuple;
+	size_t words = (seg->length + 63) / 64;
+	seg->bits.assign(words, ~0ULL);
+	if (seg->length % 64 != 0)
+		seg->bits[words - 1] = (1ULL << (seg->length % 64)) - 1;
+
+	for (size_t i = 0; i < sieve->primes.size(); i++) {
+		uint32_t q = sieve->primes[i];
+		uint64_t r = residue(q);
+		for (int m = 0; m < tuple->members; m++) {
+			uint32_t target = sieve->targets[i * TUPLE_MAX_MEMBERS + m];
+			if (target == TUPLE_NO_TARGET)
+				continue;
+			// Offset of the first p of the segment with a member multiple of q
+			uint64_t k = target >= r ? target - r : q - r + target;
+			while (small_base <= q && (small_base + k) * tuple->a[m] + tuple->b[m] <= q)
+				k += q;
+			for (; k < seg->length; k += q)
+				seg->bits[k >> 6] &= ~(1ULL << (k & 63));
+		}
+	}
+
+	stats->candidates += seg->length;
+	for (uint64_t w : seg->bits)
+		stats->survivors += __builtin_popcountll(w);
+}
+
+/*
+* Sieve the values p of the segment [base, base + seg->length) for the constellation of `sieve`.
+* For each small prime, `base mod q` is computed once, then every p with a member multiple of q is
+* struck out of `seg->bits`.
+* stats : updated with the number of values covered and the number of surviving tuples.
+*/
+void tuple_segment_fill(sieve_segment * seg, const mpz_class& base, const tuple_sieve * sieve, sieve_stats * stats) {
+	uint64_t small_base = mpz_fits_ulong_p(base.get_mpz_t()) ? base.get_ui() : UINT64_MAX;
+	tuple_segment_strike(seg, small_base, sieve, stats, [&](uint32_t q) { return mpz_fdiv_ui(base.get_mpz_t(), q); });
+}
+
+/*
+* Same as above for a 64 bits base.
+*/
+void tuple_segment_fill(sieve_segment * seg, uint64_t base, const tuple_sieve * sieve, sieve_stats * stats) {
+	tuple_segment_strike(seg, base, sieve, stats, [&](uint32_t q) { return base % q; });
+}
@@ -0,0 +1,277 @@
+/*
+ * Unix domain socket server of the prime queries, see query-server.hpp.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "query-server.hpp"
+
+// Set by SIGINT and SIGTERM, checked between two waits of QUERY_POLL_MS
+static volatile sig_atomic_t query_stop = 0;
+
+static void query_stop_handler(int) {
+	query_stop = 1;
+}
+
+QueryServer::QueryServer(const std::string& path)
+	: mPath(path)
+	, mListen(-1)
+	, mCurrent(0)
+	, mBuffer(QUERY_BUFFER)
+	, mMalformed(false) {
+	struct sigaction action{};
+	action.sa_handler = query_stop_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	struct sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+		return;
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	// Only a socket is replaced, never a regular file given by mistake
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return;
+	if (bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+		close(fd);
+		return;
+	}
+	mListen = fd;
+}
+
+QueryServer::~QueryServer() {
+	for (const query_client& client : mClients) {
+		if (client.fd >= 0)
+			close(client.fd);
+	}
+	if (mListen >= 0) {
+		close(mListen);
+		unlink(mPath.c_str());
+	}
+}
+
+/*
+* Drop the clients which are gone or have sent all their batches and read all their replies, then
+* take the first complete batch of the clients after the client of the last batch, so that every
+* client gets its turn. A client whose last reply is not sent yet waits for its next turn.
+* return : false if no client has a complete batch.
+*/
+bool QueryServer::take_batch(std::string* batch) {
+	size_t start = mCurrent + 1;
+	for (size_t i = 0; i < mClients.size();) {
+		query_client& client = mClients[i];
+		if (client.fd >= 0 && (!client.closed || !client.output.empty() || client.pending.find("\n\n") != std::string::npos)) {
+			i++;
+			continue;
+		}
+		if (client.fd >= 0)
+			close(client.fd);
+		mClients.erase(mClients.begin() + i);
+		if (i < start)
+			start--;
+	}
+	for (size_t k = 0; k < mClients.size(); k++) {
+		size_t i = (start + k) % mClients.size();
+		if (!mClients[i].output.empty())
+			continue;
+		std::string& pending = mClients[i].pending;
+		size_t end = pending.find("\n\n");
+		if (end != std::string::npos) {
+			batch->assign(pending, 0, end);
+			pending.erase(0, end + 2);
+			mCurrent = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+* Wait up to `timeout` milliseconds for new clients, requests and clients reading their replies,
+* then receive the requests and send the replies.
+*/
+void QueryServer::wait(int timeout) {
+	std::vector<struct pollfd> fds = {{mListen, POLLIN, 0}};
+	std::vector<query_client*> polled;
+	for (query_client& client : mClients) {
+		short events = (client.closed ? 0 : POLLIN) | (client.output.empty() ? 0 : POLLOUT);
+		if (client.fd >= 0 && events != 0) {
+			fds.push_back({client.fd, events, 0});
+			polled.push_back(&client);
+		}
+	}
+	if (poll(fds.data(), fds.size(), timeout) <= 0)
+		return;
+	for (size_t i = 0; i < polled.size(); i++) {
+		short revents = fds[i + 1].revents;
+		// A client which is gone fails its next send and is dropped
+		if (revents & (POLLOUT | POLLERR | POLLHUP))
+			flush(polled[i]);
+		if ((revents & (POLLIN | POLLERR | POLLHUP)) && !polled[i]->closed)
+			receive(polled[i]);
+	}
+	if (fds[0].revents & POLLIN) {
+		int fd = accept(mListen, NULL, NULL);
+		// A client which does not read must not hold the server in a send
+		if (fd >= 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+			close(fd);
+		else if (fd >= 0)
+			mClients.push_back({fd, std::string(), false, std::string(), 0});
+	}
+}
+
+/*
+* Receive what `client` sent. A batch ends with an empty line, or with the end of the requests of
+* the client, which may send its last batch without the empty line then shut its side down.
+*/
+void QueryServer::receive(query_client* client) {
+	ssize_t size = read(client->fd, mBuffer.data(), mBuffer.size());
+	if (size < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (size <= 0) {
+		client->closed = true;
+		if (client->pending.find_first_not_of(" \t\n") != std::string::npos)
+			client->pending += "\n\n";
+		return;
+	}
+	for (ssize_t i = 0; i < size; i++) {
+		if (mBuffer[i] != '\r')
+			client->pending.push_back(mBuffer[i]);
+	}
+	// A client which never ends its batch must not use up the memory of the server
+	if (client->pending.size() > QUERY_PENDING_MAX) {
+		// Without waiting, the client may not read its replies
+		const char* error = "error: batch too large\n";
+		::send(client->fd, error, strlen(error), MSG_NOSIGNAL | MSG_DONTWAIT);
+		drop(client);
+	}
+}
+
+/*
+* Send the bytes queued for `client` that its socket takes without waiting, dropping it if it is
+* gone.
+*/
+void QueryServer::flush(query_client* client) {
+	while (client->fd >= 0 && client->written < client->output.size()) {
+		ssize_t sent = ::send(client->fd, client->output.data() + client->written, client->output.size() - client->written, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (sent <= 0) {
+			drop(client);
+			return;
+		}
+		client->written += sent;
+	}
+	// Bytes sent are only removed once they are the larger part of the queue
+	if (client->written == client->output.size()) {
+		client->output.clear();
+		client->written = 0;
+	} else if (client->written > client->output.size() / 2) {
+		client->output.erase(0, client->written);
+		client->written = 0;
+	}
+}
+
+/*
+* Close the connection of `client`, which is removed by the next `take_batch`.
+*/
+void QueryServer::drop(query_client* client) {
+	close(client->fd);
+	client->fd = -1;
+	client->closed = true;
+	client->pending.clear();
+	client->output.clear();
+	client->written = 0;
+}
+
+/*
+* Read the intervals of a batch, pairs of decimal integers separated by blanks.
+* return : false if a value is not an integer or a bound is missing.
+*/
+bool QueryServer::parse(const std::string& batch, std::vector<mpz_class>* intervals) {
+	const char* blanks = " \t\n";
+	size_t begin = batch.find_first_not_of(blanks);
+	std::string token;
+	while (begin != std::string::npos) {
+		size_t end = batch.find_first_of(blanks, begin);
+		token.assign(batch, begin, end == std::string::npos ? std::string::npos : end - begin);
+		intervals->emplace_back();
+		if (intervals->back().set_str(token, 10) != 0)
+			return false;
+		begin = end == std::string::npos ? end : batch.find_first_not_of(blanks, end);
+	}
+	return intervals->size() % 2 == 0;
+}
+
+bool QueryServer::next(std::vector<mpz_class>* intervals) {
+	std::string batch;
+	while (!query_stop) {
+		// Clients which sent a request during the last batch get their turn before the next one
+		wait(0);
+		if (!take_batch(&batch)) {
+			wait(QUERY_POLL_MS);
+			continue;
+		}
+		intervals->clear();
+		mMalformed = !parse(batch, intervals);
+		if (mMalformed)
+			intervals->clear();
+		return true;
+	}
+	return false;
+}
+
+/*
+* Queue `size` bytes for the client of the last batch and send what its socket takes, dropping it if
+* it is gone or leaves more than QUERY_UNSENT_MAX bytes unread.
+*/
+void QueryServer::send(const char* data, size_t size) {
+	query_client& client = mClients[mCurrent];
+	if (client.fd < 0)
+		return;
+	client.output.append(data, size);
+	flush(&client);
+	if (client.fd >= 0 && client.output.size() - client.written > QUERY_UNSENT_MAX)
+		drop(&client);
+}
+
+void QueryServer::reply(const PrimeList* primes) {
+	std::string out;
+	out.reserve(QUERY_BUFFER);
+	std::vector<char> digits;
+	for (const mpz_class& prime : *primes) {
+		size_t size = mpz_sizeinbase(prime.get_mpz_t(), 10) + 2;
+		if (digits.size() < size)
+			digits.resize(size);
+		mpz_get_str(digits.data(), 10, prime.get_mpz_t());
+		out += digits.data();
+		out += ' ';
+		if (out.size() >= QUERY_BUFFER) {
+			send(out.data(), out.size());
+			out.clear();
+		}
+	}
+	out += '\n';
+	send(out.data(), out.size());
+}
+
+void QueryServer::reply_error(const std::string& reason) {
+	std::string out = "error: " + reason + "\n";
+	send(out.data(), out.size());
+}
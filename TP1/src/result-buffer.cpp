@@ -0,0 +1,47 @@
+/*
+ * Per worker result buffers and their merge, see result-buffer.hpp.
+ */
+
+#include <algorithm>
+
+#include "result-buffer.hpp"
+
+ResultMerge::ResultMerge(std::vector<result_buffer>* buffers, const std::vector<mpz_class>* bases, PrimeList* output)
+	: mBuffers(buffers)
+	, mSliceBases(bases)
+	, mOutput(output) {
+	for (size_t b = 0; b < buffers->size(); b++)
+		for (size_t r = 0; r < buffers->at(b).runs.size(); r++)
+			if (buffers->at(b).runs[r].count > 0)
+				mRuns.push_back({b, r, 0});
+
+	// Order runs by key, pieces never overlap so the keys are all different
+	std::sort(mRuns.begin(), mRuns.end(), [&](const placed_run& a, const placed_run& b) {
+		const result_run& ra = buffers->at(a.buffer).runs[a.run];
+		const result_run& rb = buffers->at(b.buffer).runs[b.run];
+		return ra.slice != rb.slice ? ra.slice < rb.slice : ra.begin < rb.begin;
+	});
+	size_t size = 0;
+	for (placed_run& p : mRuns) {
+		p.offset = size;
+		size += buffers->at(p.buffer).runs[p.run].count;
+	}
+
+	// One output run per piece
+	output->mBases.resize(mRuns.size());
+	output->mEnds.resize(mRuns.size());
+	output->mOffsets.resize(size);
+}
+
+void ResultMerge::move(int part, int nb_parts) {
+	size_t lo = mRuns.size() * part / nb_parts;
+	size_t hi = mRuns.size() * (part + 1) / nb_parts;
+	for (size_t i = lo; i < hi; i++) {
+		const placed_run& p = mRuns[i];
+		const result_buffer& buffer = mBuffers->at(p.buffer);
+		const result_run& run = buffer.runs[p.run];
+		mpz_add_ui(mOutput->mBases[i].get_mpz_t(), (*mSliceBases)[run.slice].get_mpz_t(), run.begin);
+		mOutput->mEnds[i] = p.offset + run.count;
+		std::copy(buffer.offsets.begin() + run.first, buffer.offsets.begin() + run.first + run.count, mOutput->mOffsets.begin() + p.offset);
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ * Persistent pool of pthread workers, see thread-pool.hpp.
+ */
+
+#include "thread-pool.hpp"
+
+// Argument of `ThreadPool::loop`
+struct pool_thread {
+	ThreadPool * pool;
+	pool_worker * worker;
+};
+
+ThreadPool::ThreadPool(int nb_threads, uint64_t seed)
+	: mWorkers(nb_threads)
+	, mThreads(nb_threads)
+	, mJob(NULL)
+	, mGeneration(0)
+	, mPending(0)
+	, mStop(false) {
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mWake, NULL);
+	pthread_cond_init(&mDone, NULL);
+	for (int i = 0; i < nb_threads; i++) {
+		mWorkers[i].index = i;
+		witness_rng_init(&mWorkers[i].rng, seed, i);
+		pthread_create(&mThreads[i], NULL, &ThreadPool::loop, new pool_thread{this, &mWorkers[i]});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	pthread_mutex_lock(&mMutex);
+	mStop = true;
+	pthread_cond_broadcast(&mWake);
+	pthread_mutex_unlock(&mMutex);
+	for (size_t i = 0; i < mThreads.size(); i++)
+		pthread_join(mThreads[i], NULL);
+	pthread_cond_destroy(&mDone);
+	pthread_cond_destroy(&mWake);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void ThreadPool::run(const std::function<void(pool_worker *)>& job) {
+	pthread_mutex_lock(&mMutex);
+	mJob = &job;
+	mPending = (int) mWorkers.size();
+	mGeneration++;
+	pthread_cond_broadcast(&mWake);
+	while (mPending > 0)
+		pthread_cond_wait(&mDone, &mMutex);
+	mJob = NULL;
+	pthread_mutex_unlock(&mMutex);
+}
+
+/*
+* Body of a worker thread: wait for a new job, run it, report it done, until the pool stops.
+* data : `pool_thread` pointer, property of the thread.
+*/
+void * ThreadPool::loop(void * data) {
+	pool_thread * pt = (pool_thread *) data;
+	ThreadPool * pool = pt->pool;
+	pool_worker * worker = pt->worker;
+	delete(pt);
+
+	unsigned long seen = 0;
+	pthread_mutex_lock(&pool->mMutex);
+	for (;;) {
+		while (!pool->mStop && pool->mGeneration == seen)
+			pthread_cond_wait(&pool->mWake, &pool->mMutex);
+		if (pool->mStop)
+			break;
+		seen = pool->mGeneration;
+		const std::function<void(pool_worker *)> * job = pool->mJob;
+		pthread_mutex_unlock(&pool->mMutex);
+
+		(*job)(worker);
+
+		pthread_mutex_lock(&pool->mMutex);
+		if (--pool->mPending == 0)
+			pthread_cond_signal(&pool->mDone);
+	}
+	pthread_mutex_unlock(&pool->mMutex);
+	return NULL;
+}
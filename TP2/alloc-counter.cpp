@@ -0,0 +1,45 @@
+/*
+ * Counter of the GMP heap allocations, see alloc-counter.hpp.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <gmp.h>
+
+#include "alloc-counter.hpp"
+
+static std::atomic<uint64_t> nb_allocs(0);
+static std::atomic<uint64_t> nb_reallocs(0);
+
+static void* counted_alloc(size_t size)
+{
+	nb_allocs.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size);
+	if (p == NULL)
+		abort();
+	return p;
+}
+
+static void* counted_realloc(void* p, size_t, size_t size)
+{
+	nb_reallocs.fetch_add(1, std::memory_order_relaxed);
+	p = realloc(p, size);
+	if (p == NULL)
+		abort();
+	return p;
+}
+
+static void counted_free(void* p, size_t)
+{
+	free(p);
+}
+
+void alloc_counter_install()
+{
+	mp_set_memory_functions(&counted_alloc, &counted_realloc, &counted_free);
+}
+
+alloc_counts alloc_counter_get()
+{
+	return {nb_allocs.load(std::memory_order_relaxed), nb_reallocs.load(std::memory_order_relaxed)};
+}
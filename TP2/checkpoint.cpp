@@ -0,0 +1,129 @@
+/*
+ * Checkpoints of a streaming run, see checkpoint.hpp.
+ */
+
+#include <cstdio>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.hpp"
+
+Checkpoint::Checkpoint(const std::string& results, const std::string& input, prime_test test, size_t rounds)
+	: mResults(results)
+	, mTest(prime_test_name(test))
+	, mRounds(prob_prime_mr_rounds(rounds))
+	, mHasHighWater(false)
+	, mLength(0)
+	, mResumed(false) {
+	// A checkpoint only applies to the same input file
+	struct stat st;
+	long long size = stat(input.c_str(), &st) == 0 ? (long long) st.st_size : -1;
+	mInput = input + " " + std::to_string(size);
+}
+
+/*
+* Read the checkpoint file into mHighWater and mLength.
+* return : false if it is missing, malformed, or was saved for another input, test or rounds.
+*/
+bool Checkpoint::load() {
+	std::ifstream file(mResults + CHECKPOINT_SUFFIX);
+	std::string input, test, high;
+	size_t rounds;
+	if (!getline(file, input) || !(file >> test >> rounds >> high >> mLength))
+		return false;
+	if (input != mInput || test != mTest || rounds != mRounds) {
+		mError = "checkpoint of another input, test or rounds";
+		return false;
+	}
+	// "-" until the first task is written
+	mHasHighWater = high != "-";
+	if (mHasHighWater && mHighWater.set_str(high, 10) != 0)
+		return false;
+	return true;
+}
+
+/*
+* Write the checkpoint file aside then rename it over the previous one, so a checkpoint is either
+* the previous or the new one, never a part of it.
+*/
+void Checkpoint::store() {
+	std::string path = mResults + CHECKPOINT_SUFFIX;
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream file(tmp);
+		file << mInput << "\n" << mTest << " " << mRounds << " ";
+		if (mHasHighWater)
+			file << mHighWater;
+		else
+			file << "-";
+		file << " " << mLength << std::endl;
+		if (!file)
+			return;
+	}
+	rename(tmp.c_str(), path.c_str());
+	mLast = std::chrono::steady_clock::now();
+}
+
+bool Checkpoint::open(bool resume) {
+	bool header = true;
+	if (resume) {
+		if (!load()) {
+			if (mError.empty())
+				mError = "no checkpoint to resume from";
+			return false;
+		}
+		// Drop the primes written after the checkpoint
+		if (truncate(mResults.c_str(), mLength) != 0) {
+			mError = "can't cut the results back to the checkpoint";
+			return false;
+		}
+		// Opened for update, not to append: the stream then knows its position
+		mFile.open(mResults, std::ios::binary | std::ios::in | std::ios::out);
+		mFile.seekp(0, std::ios::end);
+		header = mLength == 0;
+		mResumed = mHasHighWater;
+	} else {
+		mFile.open(mResults, std::ios::binary | std::ios::trunc);
+	}
+	if (!mFile.is_open()) {
+		mError = "can't open the results";
+		return false;
+	}
+	mWriter.reset(new PrimeWriter(mFile, header));
+	// The header is part of every checkpoint
+	mWriter->flush();
+	mLength = mFile.tellp();
+	store();
+	return true;
+}
+
+void Checkpoint::save(const mpz_class& high_water, bool force) {
+	mHighWater = high_water;
+	mHasHighWater = true;
+	if (!force && std::chrono::steady_clock::now() - mLast < std::chrono::seconds(CHECKPOINT_PERIOD))
+		return;
+	// Results first, a checkpoint never covers primes which are not in the file
+	mWriter->flush();
+	mLength = mFile.tellp();
+	store();
+}
+
+bool Checkpoint::dump(std::ostream& out, bool binary, char separator) {
+	mWriter.reset();
+	mFile.close();
+	std::ifstream file(mResults, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	if (binary) {
+		out << file.rdbuf();
+		out.flush();
+		return true;
+	}
+	bool ok = prime_file_for_each(file, [&](const mpz_class& prime) {
+		out << prime << separator;
+	});
+	out.flush();
+	return ok;
+}
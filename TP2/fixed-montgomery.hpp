@@ -0,0 +1,311 @@
+#ifndef FIXED_MONTGOMERY_HPP
+#define FIXED_MONTGOMERY_HPP
+
+/*
+ * Fixed width Montgomery arithmetic for odd moduli of N 64 bits limbs (little endian, same layout
+ * as GMP limbs). Every size is known at compile time, so the inner loops of the kernels are fully
+ * unrolled and there is no size dispatch, normalisation or allocation per operation, unlike
+ * `mpz_powm`.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+static_assert(GMP_LIMB_BITS == 64 && GMP_NAIL_BITS == 0, "FixedMontgomery expects 64 bits GMP limbs");
+
+// Smallest and largest limb counts handled by FixedMontgomery
+#define FIXED_MONTGOMERY_MIN_LIMBS 2
+#define FIXED_MONTGOMERY_MAX_LIMBS 16
+
+// Shared by the 64 bits kernels of miller-rabin-gmp.cpp, __extension__ keeps -pedantic quiet
+__extension__ typedef unsigned __int128 uint128_t;
+
+template <size_t N>
+class FixedMontgomery {
+public:
+	/*
+	* Prepare the Montgomery constants for the modulus `modulus` (N limbs, odd, top limb not null).
+	*/
+	FixedMontgomery(const uint64_t* modulus) {
+		for (size_t i = 0; i < N; i++)
+			mN[i] = modulus[i];
+		// n^-1 mod 2^64 by Newton iteration, then negate
+		uint64_t inv = mN[0];
+		for (int i = 0; i < 5; i++)
+			inv *= 2 - mN[0] * inv;
+		mNInv = -inv;
+		// R^2 mod n with R = 2^(64 N)
+		mp_limb_t num[2 * N + 1] = {};
+		mp_limb_t quot[N + 2];
+		num[2 * N] = 1;
+		mpn_tdiv_qr(quot, mR2, 0, num, 2 * N + 1, mN, N);
+		uint64_t one[N] = {1};
+		toMont(mOne, one);
+		sub(mMinusOne, mN, mOne);
+	}
+
+	// Modulus, R mod n (1 in Montgomery form) and n - R mod n (-1 in Montgomery form)
+	inline const uint64_t* modulus() const {
+		return mN;
+	}
+	inline const uint64_t* one() const {
+		return mOne;
+	}
+	inline const uint64_t* minusOne() const {
+		return mMinusOne;
+	}
+
+	/*
+	* r = a * b / R mod n, for a, b < n. `r` may alias `a` or `b`.
+	* Product scanning (Finely Integrated Product Scanning) Montgomery multiplication: each column
+	* of the product and of the reduction is accumulated in a 3 limbs accumulator, so the whole
+	* kernel stays in registers once the loops are unrolled.
+	*/
+	inline void mul(uint64_t* r, const uint64_t* a, const uint64_t* b) const {
+		uint64_t m[N];
+		uint64_t t[N];
+		accumulator c = {0, 0, 0};
+#pragma GCC unroll 16
+		for (size_t i = 0; i < N; i++) {
+#pragma GCC unroll 16
+			for (size_t j = 0; j < i; j++) {
+				mac(c, a[j], b[i - j]);
+				mac(c, m[j], mN[i - j]);
+			}
+			mac(c, a[i], b[0]);
+			m[i] = c.lo * mNInv;
+			mac(c, m[i], mN[0]);
+			shift(c);
+		}
+#pragma GCC unroll 16
+		for (size_t i = N; i < 2 * N - 1; i++) {
+#pragma GCC unroll 16
+			for (size_t j = i - N + 1; j < N; j++) {
+				mac(c, a[j], b[i - j]);
+				mac(c, m[j], mN[i - j]);
+			}
+			t[i - N] = c.lo;
+			shift(c);
+		}
+		t[N - 1] = c.lo;
+		finalSub(r, t, c.hi);
+	}
+
+	/*
+	* r = a^2 / R mod n, for a < n. `r` may alias `a`.
+	* Same as `mul`, but each cross product a[j] * a[i - j] is computed once and doubled.
+	*/
+	inline void sqr(uint64_t* r, const uint64_t* a) const {
+		uint64_t m[N];
+		uint64_t t[N];
+		accumulator c = {0, 0, 0};
+#pragma GCC unroll 16
+		for (size_t i = 0; i < N; i++) {
+#pragma GCC unroll 16
+			for (size_t j = 0; j < i - j; j++)
+				mac2(c, a[j], a[i - j]);
+			if (i % 2 == 0)
+				mac(c, a[i / 2], a[i / 2]);
+#pragma GCC unroll 16
+			for (size_t j = 0; j < i; j++)
+				mac(c, m[j], mN[i - j]);
+			m[i] = c.lo * mNInv;
+			mac(c, m[i], mN[0]);
+			shift(c);
+		}
+#pragma GCC unroll 16
+		for (size_t i = N; i < 2 * N - 1; i++) {
+#pragma GCC unroll 16
+			for (size_t j = i - N + 1; j < i - j; j++)
+				mac2(c, a[j], a[i - j]);
+			if (i % 2 == 0)
+				mac(c, a[i / 2], a[i / 2]);
+#pragma GCC unroll 16
+			for (size_t j = i - N + 1; j < N; j++)
+				mac(c, m[j], mN[i - j]);
+			t[i - N] = c.lo;
+			shift(c);
+		}
+		t[N - 1] = c.lo;
+		finalSub(r, t, c.hi);
+	}
+
+	/*
+	* r = a + b mod n, for a, b < n. `r` may alias `a` or `b`.
+	*/
+	inline void addMod(uint64_t* r, const uint64_t* a, const uint64_t* b) const {
+		uint64_t t[N];
+		uint64_t carry = add(t, a, b);
+		finalSub(r, t, carry);
+	}
+
+	/*
+	* r = a - b mod n, for a, b < n. `r` may alias `a` or `b`.
+	*/
+	inline void subMod(uint64_t* r, const uint64_t* a, const uint64_t* b) const {
+		if (sub(r, a, b))
+			add(r, r, mN);
+	}
+
+	/*
+	* r = a / 2 mod n, for a < n. Halving commutes with the Montgomery form. `r` may alias `a`.
+	*/
+	inline void half(uint64_t* r, const uint64_t* a) const {
+		uint64_t t[N];
+		uint64_t carry = 0;
+		if (a[0] & 1)
+			carry = add(t, a, mN);
+		else
+			copy(t, a);
+		for (size_t i = 0; i + 1 < N; i++)
+			r[i] = (t[i] >> 1) | (t[i + 1] << 63);
+		r[N - 1] = (t[N - 1] >> 1) | (carry << 63);
+	}
+
+	/*
+	* r = a * R mod n, for a < n.
+	*/
+	inline void toMont(uint64_t* r, const uint64_t* a) const {
+		mul(r, a, mR2);
+	}
+
+	/*
+	* r = a^e mod n with `a` and `r` in Montgomery form, `e` given as `e_size` limbs (top limb not
+	* null). Left to right sliding window exponentiation, windows of up to 5 bits.
+	*/
+	void pow(uint64_t* r, const uint64_t* a, const uint64_t* e, size_t e_size) const {
+		// Odd powers a, a^3, ..., a^31
+		uint64_t table[16][N];
+		uint64_t a2[N];
+		copy(table[0], a);
+		sqr(a2, a);
+		for (size_t i = 1; i < 16; i++)
+			mul(table[i], table[i - 1], a2);
+
+		uint64_t x[N];
+		copy(x, mOne);
+		bool started = false;
+		long bit	 = 64 * e_size - 1 - __builtin_clzll(e[e_size - 1]);
+		while (bit >= 0) {
+			if (!testBit(e, bit)) {
+				sqr(x, x);
+				bit--;
+				continue;
+			}
+			// Longest window [low, bit] of at most 5 bits ending with a set bit
+			long low = bit - 4 < 0 ? 0 : bit - 4;
+			while (!testBit(e, low))
+				low++;
+			unsigned w = 0;
+			for (long b = bit; b >= low; b--) {
+				w = (w << 1) | testBit(e, b);
+				if (started)
+					sqr(x, x);
+			}
+			if (started)
+				mul(x, x, table[w >> 1]);
+			else
+				copy(x, table[w >> 1]);
+			started = true;
+			bit		= low - 1;
+		}
+		copy(r, x);
+	}
+
+	static inline bool equal(const uint64_t* a, const uint64_t* b) {
+		for (size_t i = 0; i < N; i++)
+			if (a[i] != b[i])
+				return false;
+		return true;
+	}
+
+	static inline bool isZero(const uint64_t* a) {
+		for (size_t i = 0; i < N; i++)
+			if (a[i] != 0)
+				return false;
+		return true;
+	}
+
+	static inline void copy(uint64_t* r, const uint64_t* a) {
+		for (size_t i = 0; i < N; i++)
+			r[i] = a[i];
+	}
+
+private:
+	// Column accumulator of the product scanning kernels
+	struct accumulator {
+		uint64_t lo, hi, top;
+	};
+
+	// c += x * y
+	static inline void mac(accumulator& c, uint64_t x, uint64_t y) {
+		uint128_t p = (uint128_t) x * y;
+		uint128_t s = ((uint128_t) c.hi << 64 | c.lo) + p;
+		c.top += s < p;
+		c.lo = (uint64_t) s;
+		c.hi = s >> 64;
+	}
+
+	// c += 2 * x * y
+	static inline void mac2(accumulator& c, uint64_t x, uint64_t y) {
+		uint128_t p = (uint128_t) x * y;
+		c.top += p >> 127;
+		p <<= 1;
+		uint128_t s = ((uint128_t) c.hi << 64 | c.lo) + p;
+		c.top += s < p;
+		c.lo = (uint64_t) s;
+		c.hi = s >> 64;
+	}
+
+	// Move to the next column, c /= 2^64
+	static inline void shift(accumulator& c) {
+		c.lo  = c.hi;
+		c.hi  = c.top;
+		c.top = 0;
+	}
+
+	static inline unsigned testBit(const uint64_t* e, long bit) {
+		return (e[bit / 64] >> (bit % 64)) & 1;
+	}
+
+	// r = a + b, returns the carry
+	static inline uint64_t add(uint64_t* r, const uint64_t* a, const uint64_t* b) {
+		uint64_t carry = 0;
+		for (size_t i = 0; i < N; i++) {
+			uint128_t s = (uint128_t) a[i] + b[i] + carry;
+			r[i]		= (uint64_t) s;
+			carry		= s >> 64;
+		}
+		return carry;
+	}
+
+	// r = a - b, returns the borrow
+	static inline uint64_t sub(uint64_t* r, const uint64_t* a, const uint64_t* b) {
+		uint64_t borrow = 0;
+		for (size_t i = 0; i < N; i++) {
+			uint128_t d = (uint128_t) a[i] - b[i] - borrow;
+			r[i]		= (uint64_t) d;
+			borrow		= (d >> 64) & 1;
+		}
+		return borrow;
+	}
+
+	// r = t mod n for t = (top, t[0..N-1]) < 2n
+	inline void finalSub(uint64_t* r, const uint64_t* t, uint64_t top) const {
+		uint64_t d[N];
+		uint64_t borrow = sub(d, t, mN);
+		if (top != 0 || borrow == 0)
+			copy(r, d);
+		else
+			copy(r, t);
+	}
+
+	uint64_t mN[N];		   //! modulus
+	uint64_t mNInv;		   //! -n^-1 mod 2^64
+	uint64_t mR2[N];	   //! R^2 mod n
+	uint64_t mOne[N];	   //! R mod n
+	uint64_t mMinusOne[N]; //! n - R mod n
+};
+
+#endif //! FIXED_MONTGOMERY_HPP
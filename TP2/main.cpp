@@ -4,9 +4,9 @@
  * \author Vincent Commin & Louis Leenart
  */
 
+#include <ctime>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -14,96 +14,200 @@
 #include <omp.h>
 
 #include "Chrono.hpp"
+#include "alloc-counter.hpp"
+#include "checkpoint.hpp"
+#include "cost-model.hpp"
+#include "interval-reader.hpp"
 #include "miller-rabin-gmp.hpp"
-
-/*
-* Encapsulation comparaison operator for pair of mpz_class. Used for std::sort.
-*/
-bool comp_pair(std::pair<mpz_class, mpz_class> a, std::pair<mpz_class, mpz_class> b) { 
-	return a.first < b.first;
-}
-
-/*
-* Merge pair of mpz_class as intervals, to reduce overlapping and to not check if a number is prime
-* multiples times.
-*
-* result pointer is property of caller
-*/
-std::vector<std::pair<mpz_class, mpz_class>>* merge_intervals(std::vector<std::pair<mpz_class, mpz_class>>* intervals) {
-	// Sort array by first element of pairs
-	std::sort(intervals->begin(), intervals->end(), comp_pair);
-	std::vector<std::pair<mpz_class, mpz_class>> *merged = new std::vector<std::pair<mpz_class, mpz_class>>();
-	
-	for (std::pair<mpz_class, mpz_class> pair : *intervals) {
-		// if the list of merged intervals is empty or if the current interval does not overlap with
-		// the previous interval, append it.
-		if (merged->empty() || (merged->back().second < pair.first)) {
-			merged->push_back(pair);
-		} else {
-			// there is overlap, so we merge the current and previous intervals.
-			merged->back().second = std::max(merged->back().second, pair.second);
-		}
-	}
-	return merged; // Property of caller
-}
+#include "pipeline.hpp"
+#include "prime-file.hpp"
+#include "prime-list.hpp"
+#include "prime-search.hpp"
+#include "range-cache.hpp"
 
 // Define operator< for mpz_class. As gmp is a C library, operators are only defined by functions.
 // This is made for convinence of use
 bool operator< (const mpz_class& lhs, const mpz_class& rhs){ return mpz_cmp(lhs.get_mpz_t(), rhs.get_mpz_t()) < 0; }
 
-/* Find every likely prime value in the intervals, multi-threaded using openMP
- * 
- * rounds : number of passes of miller rabin algorithm. Higher means more precision and compute
- * time.
- * nb_threads : number of threads launched to compute. If openMP is not available, defaults as 1 thread.
- * 
- * result : vector of found likely primes in intervals. Property of caller.
+/* Find every likely prime value of the intervals read by `pipeline` and write them on the standard
+ * output as soon as they are found, in ascending order, see `Pipeline`.
+ *
+ * pipeline : stages, created for `nb_threads` scanners. Holds the counters and the errors once the
+ * function returns.
+ * nb_threads : number of scanner threads, the reader, merger and writer stages get a thread each on
+ * top of them.
+ * seed : seed of the miller-rabin witnesses, each scanner draws from the stream of its number.
+ * binary : writer of the binary output (see `PrimeWriter`), NULL to write the primes in decimal.
+* checkpoint : checkpoints of the progress, `binary` being its writer. May be NULL.
 */
-std::vector<mpz_class>* compute_prime(std::vector<std::pair<mpz_class, mpz_class>> * intervals, int rounds, int nb_threads) {
-	// Init result array
-	std::vector<mpz_class>* primes = new std::vector<mpz_class>();
-	omp_set_num_threads(nb_threads);
-	// Start parallel for loop
-	#pragma omp parallel for shared(primes, intervals, rounds)
-	for (int i = 0; i < intervals->size(); i++) {
-		// Store found primes in a local array to reduce conflicts
-		std::vector<mpz_class> local_primes{};
-		std::pair<mpz_class, mpz_class> pair = intervals->at(i);
-		gmp_randclass* rnd = initialize_seed();
-		// Iterates through every item of the interval
-		/* Note: for maximum performances, it would be wise to use openMP for this loop too but
-		 * because of its implementation, the for loop must use int as iterator, which imply some
-		 * refactor for this. I'm not sure if an int would be enough to not overflow, with merged
-		 * intervals too. For now, this is giving good performances. If more is needed, this can be
-		 * a good place to look into.
-		 * Note: it seems to be possible to iterate over an std::vector<T> with openMP parallelism,
-		 * it would be the way to improve this.
-		*/
-		for (mpz_class item = pair.first; item < pair.second; item++) {
-			if (prob_prime(item, rounds, rnd)) { // Add found prime in the local array
-				local_primes.push_back(item);
-			}
+void compute_prime_stream(Pipeline * pipeline, int nb_threads, uint64_t seed, PrimeWriter * binary, Checkpoint * checkpoint) {
+	// Every stage must get its thread, or the pipeline would wait forever
+	omp_set_dynamic(0);
+	#pragma omp parallel num_threads(nb_threads + 3) shared(pipeline)
+	{
+		int stage = omp_get_thread_num();
+		if (stage == 0)
+			pipeline->read();
+		else if (stage == 1)
+			pipeline->merge();
+		else if (stage == 2) {
+			if (binary != NULL)
+				pipeline->write(binary, checkpoint);
+			else
+				pipeline->write(std::cout, '\n');
+		}
+		else {
+			witness_rng rng;
+			witness_rng_init(&rng, seed, stage - 3);
+			pipeline->scan(&rng);
 		}
-		// When the interval is done, add found primes to the shared vector
-		primes->insert(primes->end(), local_primes.begin(), local_primes.end());
 	}
-	return primes;
+}
+
+/*
+* Print the GMP allocations done during a computation and their number per value tested by
+* miller-rabin.
+* before, after : counts at the start and at the end of the computation.
+* tested : number of values tested by miller-rabin.
+*/
+void alloc_counts_print(const alloc_counts * before, const alloc_counts * after, uint64_t tested) {
+	uint64_t allocs = after->allocs - before->allocs;
+	uint64_t reallocs = after->reallocs - before->reallocs;
+	std::cerr << "gmp: " << allocs << " allocations, " << reallocs << " reallocations, "
+		<< (tested ? (double) (allocs + reallocs) / tested : 0) << " per tested value" << std::endl;
 }
 
 int main(int argc, char** argv) {
 	// Parse args
 	if (argc < 3) {
-		std::cerr << "usage: executable <nb_threads> <filepath> [rounds]" << std::endl; 
+		std::cerr << "usage: executable <nb_threads> <filepath> [rounds] [--sieve=<bound>] [--stats] [--test=mr|fixed|bpsw] [--seed=<seed>] [--stream] [--format=text|binary] [--cache=<directory>] [--checkpoint=<filepath> [--resume]]" << std::endl; 
 		return EXIT_FAILURE;
 	}
 	unsigned int rounds = 5;
 	unsigned int nb_thread;
+	// Upper bound of the small primes used to sieve the intervals (0 to disable the sieve)
+	uint32_t sieve_bound = SIEVE_DEFAULT_BOUND;
+	// Print the sieve counters on the error output
+	bool print_stats = false;
+	// Primality test of the values larger than 64 bits
+	prime_test test = PRIME_TEST_MR_RANDOM;
+	// Seed of the miller-rabin witnesses, a run is reproduced by giving its seed back
+	uint64_t seed = time(NULL);
+	// Write the primes as they are found, with a memory bounded by the pipeline queues
+	bool stream = false;
+	// Write the primes in the binary format of prime-file.hpp instead of decimal
+	bool binary = false;
+	// Directory of the cache of the scanned ranges (see `RangeCache`), empty for no cache
+	std::string cache_dir;
+	// Results file of a checkpointed run (see `Checkpoint`), empty for no checkpoint
+	std::string checkpoint_path;
+	// Go on from the last checkpoint instead of starting over
+	bool resume = false;
 
     nb_thread = atoi(argv[1]);
-    if (argc >= 4)
-        rounds = atoi(argv[3]);
+	// Without any worker the pipeline of --stream and --checkpoint never ends
+	if (atoi(argv[1]) < 1) {
+		std::cerr << "error: nb_threads must be at least 1" << std::endl;
+		return EXIT_FAILURE;
+	}
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.rfind("--sieve=", 0) == 0)
+			sieve_bound = std::stoul(arg.substr(8));
+		else if (arg == "--stats")
+			print_stats = true;
+		else if (arg.rfind("--seed=", 0) == 0)
+			seed = std::stoull(arg.substr(7));
+		else if (arg == "--stream")
+			stream = true;
+		else if (arg.rfind("--checkpoint=", 0) == 0)
+			checkpoint_path = arg.substr(13);
+		else if (arg == "--resume")
+			resume = true;
+		else if (arg.rfind("--cache=", 0) == 0)
+			cache_dir = arg.substr(8);
+		else if (arg.rfind("--format=", 0) == 0) {
+			if (arg != "--format=text" && arg != "--format=binary") {
+				std::cerr << "error: unknown output format : " << arg.substr(9) << std::endl;
+				return EXIT_FAILURE;
+			}
+			binary = arg == "--format=binary";
+		}
+		else if (arg.rfind("--test=", 0) == 0) {
+			if (!prime_test_parse(arg.substr(7), &test)) {
+				std::cerr << "error: unknown primality test : " << arg.substr(7) << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else
+			rounds = atoi(argv[i]);
+	}
+	// Checkpoints follow the progress of the pipeline
+	if (!checkpoint_path.empty())
+		stream = true;
+	if (stream && !cache_dir.empty()) {
+		std::cerr << "error: --cache can't be used with --stream or --checkpoint" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (resume && checkpoint_path.empty()) {
+		std::cerr << "error: --resume needs --checkpoint" << std::endl;
+		return EXIT_FAILURE;
+	}
+	prob_prime_set_test(test);
+	// Count the GMP allocations from the start, so every value is allocated through the counter
+	if (print_stats)
+		alloc_counter_install();
     
-	/* Read input file
+	// Binary output, NULL to write in decimal
+	std::unique_ptr<PrimeWriter> writer(binary && checkpoint_path.empty() ? new PrimeWriter(std::cout) : NULL);
+	if (stream) {
+		IntervalReader reader(argv[2], 1);
+		if (!reader.is_open()) {
+			std::cerr << "error: can\'t open file at : " << argv[2] << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::vector<uint32_t> * sieve_primes = small_primes(sieve_bound);
+		Pipeline pipeline(&reader, nb_thread, rounds, sieve_primes);
+		// Primes go to the results file of the checkpoints, then to the output once they are all found
+		std::unique_ptr<Checkpoint> checkpoint;
+		if (!checkpoint_path.empty()) {
+			checkpoint.reset(new Checkpoint(checkpoint_path, argv[2], test, rounds));
+			if (!checkpoint->open(resume)) {
+				std::cerr << "error: " << checkpoint->error() << " : " << checkpoint_path << std::endl;
+				delete(sieve_primes);
+				return EXIT_FAILURE;
+			}
+			if (checkpoint->resumed())
+				pipeline.resume_from(checkpoint->high_water());
+		}
+		// GMP allocations before the computation
+		alloc_counts allocs = alloc_counter_get();
+		// Compute time, output included
+		Chrono c(true);
+		compute_prime_stream(&pipeline, nb_thread, seed, checkpoint ? checkpoint->writer() : writer.get(), checkpoint.get());
+		c.pause();
+		alloc_counts allocs_end = alloc_counter_get();
+		delete(sieve_primes);
+		if (checkpoint && !pipeline.malformed() && !checkpoint->dump(std::cout, binary, '\n')) {
+			std::cerr << "error: can\'t read the results back from : " << checkpoint_path << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (pipeline.malformed()) {
+			// Primes of the lines before the error are already written
+			std::cerr << "error: malformed interval file : " << argv[2] << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cerr << c.get() << std::endl;
+		if (print_stats) {
+			std::cerr << "seed: " << seed << std::endl;
+			sieve_stats_print(&pipeline.stats());
+			std::cerr << "pipeline: " << pipeline.primes() << " primes in " << pipeline.tasks() << " tasks, at most " << pipeline.peak() << " tasks buffered" << std::endl;
+			alloc_counts_print(&allocs, &allocs_end, pipeline.stats().survivors);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/* Read input file, each thread parsing a part of it
 	 * Expected format is the following :
 	 * A B
 	 * C D
@@ -111,49 +215,92 @@ int main(int argc, char** argv) {
 	 * Meaning intervals are : 
 	 * [[A, B], [C, D], ...] 
 	 */
-	std::ifstream file;
-	file.open(argv[2]);
-	if (file.is_open()) {
-	
-		std::vector<std::pair<mpz_class, mpz_class>> * intervals = new std::vector<std::pair<mpz_class, mpz_class>>();
-		std::string line;
-
-		// For each line, parse to find substring<space>substring, 
-		// then tries to parse each substring into long integers (base10)
-		// represented by GMP as a mpz_class type.
-		while (getline(file, line)) {
-			std::pair<mpz_class, mpz_class> p;
-			std::istringstream iss(line);
-			std::string val;
-			iss >> val;
-			p.first = mpz_class(val);
-			iss >> val;
-			p.second = mpz_class(val);
-			intervals->push_back(p);
+	IntervalReader reader(argv[2], nb_thread);
+	if (reader.is_open()) {
+		#pragma omp parallel for num_threads(nb_thread) schedule(static)
+		for (int part = 0; part < reader.parts(); part++)
+			reader.parse(part);
+		std::vector<mpz_class> * values = reader.values();
+		if (values == NULL) {
+			std::cerr << "error: malformed interval file : " << argv[2] << std::endl;
+			return EXIT_FAILURE;
 		}
-		file.close();
+		std::vector<std::pair<mpz_class, mpz_class>> * intervals = new std::vector<std::pair<mpz_class, mpz_class>>();
+		intervals->reserve(values->size() / 2);
+		for (size_t i = 0; i < values->size(); i += 2)
+			intervals->emplace_back(std::move(values->at(i)), std::move(values->at(i + 1)));
+		delete(values);
 
-		// Vector of found likely primes in intervals
-		std::vector<mpz_class> * primes;
+		// List of found likely primes in intervals
+		PrimeList * primes;
 		// Compute time
 		std::vector<std::pair<mpz_class, mpz_class>> * merged = merge_intervals(intervals);
+		std::vector<uint32_t> * sieve_primes = small_primes(sieve_bound);
+		// Expected cost of the intervals
+		cost_model * model = cost_model_calibrate(rounds, sieve_primes);
+		sieve_stats stats{};
+		// GMP allocations before the computation
+		alloc_counts allocs = alloc_counter_get();
 		Chrono c(true);
 		// Launch computation for every intervals
-		primes = compute_prime(merged, rounds, nb_thread);
+		if (cache_dir.empty()) {
+			primes = compute_prime(merged, rounds, nb_thread, sieve_primes, model, &stats, seed);
+		} else {
+			// Only the parts of the intervals not found in the cache are scanned
+			RangeCache cache(cache_dir, test, rounds);
+			if (!cache.is_open()) {
+				std::cerr << "error: can\'t open cache at : " << cache_dir << std::endl;
+				return EXIT_FAILURE;
+			}
+			std::vector<mpz_class> bounds;
+			for (const std::pair<mpz_class, mpz_class>& pair : *merged) {
+				bounds.push_back(pair.first);
+				bounds.push_back(pair.second);
+			}
+			std::vector<mpz_class> * gaps = cache.gaps(&bounds);
+			std::vector<std::pair<mpz_class, mpz_class>> scanned;
+			for (size_t i = 0; i < gaps->size(); i += 2)
+				scanned.emplace_back(gaps->at(i), gaps->at(i + 1));
+			delete(gaps);
+			PrimeList * computed = compute_prime(&scanned, rounds, nb_thread, sieve_primes, model, &stats, seed);
+			primes = cache.splice(computed);
+			delete(computed);
+			if (primes == NULL) {
+				std::cerr << "error: can\'t read the primes of cache at : " << cache_dir << std::endl;
+				return EXIT_FAILURE;
+			}
+			if (print_stats)
+				std::cerr << "cache: " << cache.cached() << " values cached, " << cache.scanned() << " values scanned" << std::endl;
+		}
 		c.pause();
-		// Print every found likely primes in order
-		std::sort(primes->begin(), primes->end());
-		for (mpz_class p : *primes) {
-			std::cout << p << std::endl;
+		alloc_counts allocs_end = alloc_counter_get();
+		// Print every found likely primes, already in order
+		if (binary) {
+			for (size_t run = 0; run < primes->runs(); run++)
+				writer->run(primes->run_base(run), primes->run_offsets(run), primes->run_size(run));
+			writer->flush();
+		} else {
+			for (const mpz_class& p : *primes) {
+				std::cout << p << std::endl;
+			}
 		}
 		
 		// Time to compute
 		std::cerr << c.get() << std::endl;
+		if (print_stats) {
+			std::cerr << "seed: " << seed << std::endl;
+			sieve_stats_print(&stats);
+			cost_model_print(model);
+			std::cerr << "results: " << primes->size() << " primes in " << primes->runs() << " runs, " << primes->memory() << " bytes" << std::endl;
+			alloc_counts_print(&allocs, &allocs_end, stats.survivors);
+		}
 
 		// Clean allocations
 		delete(intervals);
 		delete(merged);
 		delete(primes);
+		delete(sieve_primes);
+		delete(model);
 		
 	} else {
 		std::cerr << "error: can\'t open file at : " << argv[2] << std::endl;
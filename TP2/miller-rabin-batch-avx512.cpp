@@ -0,0 +1,49 @@
+/*
+ * AVX-512 kernel of the lane parallel Miller-Rabin rounds (8 candidates per vector). This file is
+ * compiled with -mavx512f and only called when the CPU supports it, see `prob_prime_batch`.
+ */
+
+#include <immintrin.h>
+
+#include "miller-rabin-batch.hpp"
+
+// GCC 12 false positive on the undefined source of _mm512_mul_epu32 in avx512fintrin.h
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+namespace {
+
+struct avx512 {
+	static const size_t LANES = 8;
+	typedef __m512i vec;
+
+	static inline vec load(const uint64_t* p) {
+		return _mm512_loadu_si512(p);
+	}
+	static inline void store(uint64_t* p, vec v) {
+		_mm512_storeu_si512(p, v);
+	}
+	static inline vec set1(uint64_t x) {
+		return _mm512_set1_epi64(x);
+	}
+	static inline vec add(vec a, vec b) {
+		return _mm512_add_epi64(a, b);
+	}
+	static inline vec mul32(vec a, vec b) {
+		return _mm512_mul_epu32(a, b);
+	}
+	static inline vec and_(vec a, vec b) {
+		return _mm512_and_si512(a, b);
+	}
+	static inline vec srli(vec a, int n) {
+		return _mm512_srli_epi64(a, n);
+	}
+};
+
+} // namespace
+
+void mr_batch_round_avx512(mr_batch* batch, size_t first_lane, bool* passed) {
+	MrBatchRound<avx512>(batch, first_lane).run(passed);
+}
+
+#pragma GCC diagnostic pop
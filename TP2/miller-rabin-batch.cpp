@@ -0,0 +1,204 @@
+/*
+ * Batched Miller-Rabin front end: prepares lanes of candidates for the SIMD kernels of
+ * miller-rabin-batch.hpp, picked at runtime from the CPU features.
+ */
+
+#include <climits>
+#include <memory>
+#include <vector>
+
+#include "miller-rabin-gmp.hpp"
+#include "miller-rabin-batch.hpp"
+
+/*
+ * Measured on 2000 consecutive odd values, 25 rounds, against `prob_prime`: the AVX-512 kernel is
+ * 15 to 40% faster from 128 to 1000 bits, but slower below about 110 bits where preparing the lanes
+ * costs more than the exponentiation. The AVX2 kernel (4 lanes) is 20 to 50% slower than GMP at
+ * every size, so it is only used when MR_BATCH_AVX2 is set to 1.
+ */
+#ifndef MR_BATCH_AVX2
+#define MR_BATCH_AVX2 0
+#endif
+// Smallest number of limbs sent to the kernels
+#define MR_BATCH_MIN_LIMBS 5
+
+/*
+* Kernel usable on this CPU and its number of lanes. `kernel` is NULL when the CPU has no supported
+* SIMD extension, candidates are then tested one by one.
+*/
+struct mr_batch_dispatch {
+	mr_batch_kernel kernel;
+	size_t lanes;
+};
+
+static mr_batch_dispatch select_kernel()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return {&mr_batch_round_avx512, 8};
+	if (MR_BATCH_AVX2 && __builtin_cpu_supports("avx2"))
+		return {&mr_batch_round_avx2, 4};
+	return {NULL, 1};
+}
+
+/*
+ * Number of MR_BATCH_LIMB_BITS bits limbs used for n, such that R = 2^(limbs * MR_BATCH_LIMB_BITS)
+ * is greater than 4n.
+ */
+static size_t batch_limbs(const mpz_class& n)
+{
+	return (mpz_sizeinbase(n.get_mpz_t(), 2) + 2 + MR_BATCH_LIMB_BITS - 1) / MR_BATCH_LIMB_BITS;
+}
+
+/*
+ * Split x into `limbs` limbs of MR_BATCH_LIMB_BITS bits, stored in dst[.][lane].
+ */
+static void split_limbs(const mpz_class& x, size_t limbs, uint64_t (*dst)[MR_BATCH_MAX_LANES], size_t lane)
+{
+	for (size_t j = 0; j < limbs; j++) {
+		size_t bit = j * MR_BATCH_LIMB_BITS;
+		size_t word = bit / 64, shift = bit % 64;
+		uint64_t v = mpz_getlimbn(x.get_mpz_t(), word) >> shift;
+		if (shift + MR_BATCH_LIMB_BITS > 64)
+			v |= mpz_getlimbn(x.get_mpz_t(), word + 1) << (64 - shift);
+		dst[j][lane] = v & MR_BATCH_LIMB_MASK;
+	}
+}
+
+/*
+* Buffers of `prob_prime_batch` kept by each thread between calls, so that a call does no heap
+* allocation once they have grown to the size of the candidates.
+* batch : lanes handed to the kernel.
+* pending, next : indices of the candidates still probably prime, before and after a round.
+* d : odd part of n - 1 of each lane.
+* r, t : intermediate values of `fill_lane`.
+*/
+struct mr_batch_state {
+	mr_batch batch;
+	std::vector<size_t> pending, next;
+	mpz_class d[MR_BATCH_MAX_LANES];
+	mpz_class r, t;
+};
+
+/*
+ * Fill the Montgomery constants, the witness of `round`, and s of the `lane` of the batch for the
+ * odd candidate n. d (n - 1 = d * 2^s) is returned to be split into windows once the whole batch is known.
+ * Every value is computed in place in the buffers of `state`.
+ */
+static void fill_lane(mr_batch_state* state, size_t lane, const mpz_class& n, size_t round, witness_rng* rng, mpz_class& d)
+{
+	mr_batch* batch = &state->batch;
+	const size_t limbs = batch->limbs;
+	split_limbs(n, limbs, batch->n, lane);
+
+	// -n^-1 mod 2^MR_BATCH_LIMB_BITS, by Newton iteration on the lowest limb
+	uint64_t n0 = mpz_getlimbn(n.get_mpz_t(), 0);
+	uint64_t inv = n0;
+	for (int i = 0; i < 5; i++)
+		inv *= 2 - n0 * inv;
+	batch->n_inv[lane] = -inv & MR_BATCH_LIMB_MASK;
+
+	mpz_ptr r = state->r.get_mpz_t();
+	mpz_ptr t = state->t.get_mpz_t();
+	mpz_set_ui(r, 0);
+	mpz_setbit(r, limbs * MR_BATCH_LIMB_BITS);
+	mpz_mod(r, r, n.get_mpz_t());
+	split_limbs(state->r, limbs, batch->one, lane);
+	mpz_sub(t, n.get_mpz_t(), r);
+	split_limbs(state->t, limbs, batch->minus_one, lane);
+	mpz_mul(t, r, r);
+	mpz_mod(t, t, n.get_mpz_t());
+	split_limbs(state->t, limbs, batch->r2, lane);
+
+	prob_prime_witness(n, round, rng, &state->t);
+	split_limbs(state->t, limbs, batch->a, lane);
+
+	mpz_sub_ui(d.get_mpz_t(), n.get_mpz_t(), 1);
+	batch->s[lane] = mpz_scan1(d.get_mpz_t(), 0);
+	mpz_tdiv_q_2exp(d.get_mpz_t(), d.get_mpz_t(), batch->s[lane]);
+}
+
+/*
+ * Miller-Rabin on `count` candidates, `results[i]` being the result of `prob_prime(candidates[i],
+ * rounds, rng)`. Candidates of the same size are tested MR_BATCH_MAX_LANES (AVX-512) or 4 (AVX2)
+ * at a time; candidates fitting in 64 bits, even ones, too small or too large for the kernels, or
+ * batches too small to fill half of a vector go through `prob_prime`. Only the Miller-Rabin rounds
+ * are vectorized, the Lucas test of BPSW is run one by one on the candidates passing them.
+ */
+void prob_prime_batch(const mpz_class* candidates, size_t count, const size_t rounds, witness_rng* rng, bool* results)
+{
+	static const mr_batch_dispatch dispatch = select_kernel();
+	static thread_local std::unique_ptr<mr_batch_state> state;
+
+	if (!state)
+		state.reset(new mr_batch_state);
+	std::vector<size_t>& pending = state->pending;
+	std::vector<size_t>& next = state->next;
+	pending.clear();
+	for (size_t i = 0; i < count; i++) {
+		const mpz_class& n = candidates[i];
+		if (dispatch.kernel == NULL || mpz_cmpabs_ui(n.get_mpz_t(), ULONG_MAX) <= 0 || mpz_even_p(n.get_mpz_t()) ||
+			batch_limbs(n) < MR_BATCH_MIN_LIMBS || batch_limbs(n) > MR_BATCH_MAX_LIMBS) {
+			results[i] = prob_prime(n, rounds, rng);
+			continue;
+		}
+		results[i] = true;
+		pending.push_back(i);
+	}
+	if (pending.empty())
+		return;
+
+	mr_batch* batch = &state->batch;
+	mpz_class* d = state->d;
+	const size_t mr_rounds = prob_prime_mr_rounds(rounds);
+	for (size_t round = 0; round < mr_rounds && !pending.empty(); round++) {
+		// Candidates which survived this round
+		next.clear();
+		size_t k = 0;
+		while (k < pending.size()) {
+			// Group of consecutive candidates of the same size
+			size_t limbs = batch_limbs(candidates[pending[k]]);
+			size_t end = k;
+			while (end < pending.size() && end - k < dispatch.lanes && batch_limbs(candidates[pending[end]]) == limbs)
+				end++;
+			size_t used = end - k;
+
+			// Not worth a vector, finish the remaining rounds one by one
+			if (2 * used < dispatch.lanes) {
+				for (; k < end; k++)
+					results[pending[k]] = prob_prime_from(candidates[pending[k]], round, rounds, rng);
+				continue;
+			}
+
+			// Unused lanes compute a copy of the last candidate, their result is ignored
+			batch->limbs = limbs;
+			size_t max_bits = 0;
+			for (size_t l = 0; l < dispatch.lanes; l++) {
+				fill_lane(state.get(), l, candidates[pending[k + (l < used ? l : used - 1)]], round, rng, d[l]);
+				if (mpz_sizeinbase(d[l].get_mpz_t(), 2) > max_bits)
+					max_bits = mpz_sizeinbase(d[l].get_mpz_t(), 2);
+			}
+			batch->nb_windows = (max_bits + MR_BATCH_WINDOW_BITS - 1) / MR_BATCH_WINDOW_BITS;
+			for (size_t l = 0; l < dispatch.lanes; l++) {
+				for (size_t w = 0; w < batch->nb_windows; w++) {
+					size_t bit = (batch->nb_windows - 1 - w) * MR_BATCH_WINDOW_BITS;
+					batch->windows[w][l] = (mpz_getlimbn(d[l].get_mpz_t(), bit / 64) >> (bit % 64)) & ((1 << MR_BATCH_WINDOW_BITS) - 1);
+				}
+			}
+
+			bool passed[MR_BATCH_MAX_LANES];
+			dispatch.kernel(batch, 0, passed);
+			for (size_t l = 0; l < used; l++) {
+				if (passed[l])
+					next.push_back(pending[k + l]);
+				else
+					results[pending[k + l]] = false; // Definitely not a prime
+			}
+			k = end;
+		}
+		pending.swap(next);
+	}
+	if (prob_prime_get_test() == PRIME_TEST_BPSW)
+		for (size_t i : pending)
+			results[i] = prob_prime_from(candidates[i], mr_rounds, rounds, rng);
+}
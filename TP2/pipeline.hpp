@@ -0,0 +1,248 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+/*
+ * Streaming computation in four stages connected by bounded queues:
+ * reader (parse the lines of the interval file one at a time) -> merger (merge the intervals on the
+ * fly and cut them into numbered tasks) -> scanners (find the primes of a task) -> writer (write the
+ * primes of the tasks in order). The writer holds a reorder buffer of a few tasks per scanner:
+ * primes are written as soon as the lowest pending task is done, and the memory used is bounded by
+ * the depth of the queues instead of the number of primes found.
+ *
+ * Intervals are merged on the fly when the file is sorted by lower bound (overlapping intervals are
+ * fine). Otherwise the merger gathers and sorts every interval before handing out the first task:
+ * the input is then held in memory, but the primes are still written as they are found.
+ */
+
+#include <deque>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "interval-reader.hpp"
+#include "miller-rabin-gmp.hpp"
+#include "prime-file.hpp"
+#include "sieve.hpp"
+
+class Checkpoint;
+
+// Largest number of values of a task, primes of a task are stored as 32 bits offsets
+#define PIPELINE_TASK_SIZE (1 << 16)
+// Largest number of intervals (or parts of intervals) in a task
+#define PIPELINE_TASK_RANGES 256
+// Number of intervals parsed ahead of the merger
+#define PIPELINE_INTERVAL_DEPTH 256
+// Number of tasks waiting for a scanner, per scanner
+#define PIPELINE_TASK_DEPTH 2
+// Number of tasks being scanned or waiting to be written, per scanner
+#define PIPELINE_WINDOW 4
+
+/*
+* FIFO queue holding at most `capacity` items, `push` blocking while it is full and `pop` while it
+* is empty. Either side may `close` it: pending items can still be popped, but no more can be pushed.
+*/
+template <typename T>
+class BoundedQueue {
+public:
+	BoundedQueue(size_t capacity)
+		: mCapacity(capacity > 0 ? capacity : 1)
+		, mClosed(false) {
+		pthread_mutex_init(&mMutex, NULL);
+		pthread_cond_init(&mNotEmpty, NULL);
+		pthread_cond_init(&mNotFull, NULL);
+	}
+
+	~BoundedQueue() {
+		pthread_cond_destroy(&mNotFull);
+		pthread_cond_destroy(&mNotEmpty);
+		pthread_mutex_destroy(&mMutex);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	/*
+	* Move `item` at the end of the queue, waiting for room.
+	* return : false if the queue is closed, `item` is then left untouched.
+	*/
+	bool push(T&& item) {
+		pthread_mutex_lock(&mMutex);
+		while (!mClosed && mItems.size() >= mCapacity)
+			pthread_cond_wait(&mNotFull, &mMutex);
+		bool pushed = !mClosed;
+		if (pushed) {
+			mItems.push_back(std::move(item));
+			pthread_cond_signal(&mNotEmpty);
+		}
+		pthread_mutex_unlock(&mMutex);
+		return pushed;
+	}
+
+	/*
+	* Move the first item of the queue into `item`, waiting for one.
+	* return : false once the queue is closed and empty.
+	*/
+	bool pop(T* item) {
+		pthread_mutex_lock(&mMutex);
+		while (!mClosed && mItems.empty())
+			pthread_cond_wait(&mNotEmpty, &mMutex);
+		bool popped = !mItems.empty();
+		if (popped) {
+			*item = std::move(mItems.front());
+			mItems.pop_front();
+			pthread_cond_signal(&mNotFull);
+		}
+		pthread_mutex_unlock(&mMutex);
+		return popped;
+	}
+
+	/*
+	* Refuse any further push and wake every thread waiting on the queue.
+	*/
+	void close() {
+		pthread_mutex_lock(&mMutex);
+		mClosed = true;
+		pthread_cond_broadcast(&mNotEmpty);
+		pthread_cond_broadcast(&mNotFull);
+		pthread_mutex_unlock(&mMutex);
+	}
+
+private:
+	std::deque<T> mItems;
+	size_t mCapacity;
+	bool mClosed;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mNotEmpty; //! signaled when an item is pushed or the queue is closed
+	pthread_cond_t mNotFull;  //! signaled when an item is popped or the queue is closed
+};
+
+/*
+* Intervals to scan, numbered in ascending order of their values.
+* seq : number of the task.
+* bounds : [from1, to1, from2, to2, ...], ascending and not overlapping, each of less than
+* PIPELINE_TASK_SIZE values.
+*/
+struct pipeline_task {
+	uint64_t seq;
+	std::vector<mpz_class> bounds;
+};
+
+/*
+* Entry of the reorder buffer, holding a task from its scan until it is written.
+* task : task scanned in the slot.
+* offsets : offset of every prime of the task from the lower bound of its interval.
+* ends : index in `offsets` after the last prime of each interval of the task.
+* done : true once the task is scanned, until it is written.
+*/
+struct pipeline_slot {
+	pipeline_task task;
+	std::vector<uint32_t> offsets;
+	std::vector<size_t> ends;
+	bool done;
+};
+
+/*
+* Every stage is a method, run by the caller on threads of its own: one thread for each of `read`,
+* `merge` and `write`, and any number of threads running `scan`. Stages end by themselves once the
+* input is consumed.
+*/
+class Pipeline {
+public:
+	/*
+	* reader : reader of the interval file, read from its part 0.
+	* nb_scanners : number of threads running `scan`, used to size the queues.
+	* rounds : number of miller-rabin rounds.
+	* sieve_primes : small primes used to sieve the intervals (see `small_primes`).
+	*/
+	Pipeline(IntervalReader* reader, int nb_scanners, int rounds, const std::vector<uint32_t>* sieve_primes);
+	~Pipeline();
+
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator=(const Pipeline&) = delete;
+
+	/*
+	* Skip every value below `value`, done by a previous run (see `Checkpoint`). Must be called before
+	* the stages start.
+	*/
+	void resume_from(const mpz_class& value);
+
+	/*
+	* Reader stage: parse the intervals of the file, one line at a time.
+	*/
+	void read();
+
+	/*
+	* Merger stage: merge the overlapping intervals and cut them into tasks. When the file is sorted,
+	* a part of an interval is handed out as soon as it is read, as intervals coming next can only
+	* extend it.
+	*/
+	void merge();
+
+	/*
+	* Scanner stage: find the primes of the tasks until there is none left.
+	* rng : random stream of the miller-rabin witnesses of the thread.
+	*/
+	void scan(witness_rng* rng);
+
+	/*
+	* Writer stage: write the primes of each task in order on `out`, each followed by `separator`.
+	*/
+	void write(std::ostream& out, char separator);
+
+	/*
+	* Writer stage: write the primes of each task in order on `out`, a run per interval of the task.
+	* checkpoint : told the upper bound of each task written, so it saves the progress. May be NULL.
+	*/
+	void write(PrimeWriter* out, Checkpoint* checkpoint = NULL);
+
+	// True if a line of the file is malformed, once the stages are done
+	inline bool malformed() const {
+		return mMalformed;
+	}
+
+	// Counters, once the stages are done
+	inline const sieve_stats& stats() const {
+		return mStats;
+	}
+	inline uint64_t tasks() const {
+		return mTaskCount;
+	}
+	inline uint64_t primes() const {
+		return mPrimes;
+	}
+	// Largest number of tasks held by the reorder buffer at once
+	inline uint64_t peak() const {
+		return mPeak;
+	}
+
+private:
+	void hand_out(pipeline_task* task);
+	template <typename F>
+	void drain(F on_slot);
+
+	IntervalReader* mReader;
+	int mRounds;
+	const std::vector<uint32_t>* mSievePrimes;
+	BoundedQueue<std::pair<mpz_class, mpz_class>> mIntervals;
+	BoundedQueue<pipeline_task> mTasks;
+	std::vector<pipeline_slot> mSlots; //! reorder buffer, task `seq` goes to slot `seq % size`
+
+	pthread_mutex_t mMutex;
+	pthread_cond_t mReady;	//! signaled when a task is scanned or the last task is handed out
+	pthread_cond_t mFree;	//! signaled when a task is written
+	uint64_t mWritten;		//! number of tasks written
+	uint64_t mTaskCount;	//! number of tasks handed out
+	bool mMerged;			//! true once every task is handed out
+	uint64_t mPeak;
+	uint64_t mPrimes;
+	mpz_class mResume;		//! values below are skipped, if mResumed
+	bool mResumed;
+	sieve_stats mStats;
+	bool mMalformed;
+};
+
+#endif //! PIPELINE_HPP
@@ -0,0 +1,37 @@
+/*!
+ * \file prime-dump.cpp
+ * \brief Print the primes of a binary prime file (see prime-file.hpp) in decimal, one per line.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include <gmpxx.h>
+
+#include "prime-file.hpp"
+
+int main(int argc, char** argv) {
+	if (argc > 2) {
+		std::cerr << "usage: prime-dump [filepath]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	// Standard input when no file is given
+	std::ifstream file;
+	if (argc == 2) {
+		file.open(argv[1], std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "error: can\'t open file at : " << argv[1] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::istream& in = argc == 2 ? file : std::cin;
+	bool ok = prime_file_for_each(in, [](const mpz_class& prime) {
+		std::cout << prime << '\n';
+	});
+	std::cout.flush();
+	if (!ok) {
+		std::cerr << "error: truncated or malformed prime file" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
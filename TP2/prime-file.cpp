@@ -0,0 +1,121 @@
+/*
+ * Compact binary format for the found primes, see prime-file.hpp.
+ */
+
+#include <cstring>
+
+#include "prime-file.hpp"
+
+static const char prime_file_magic[PRIME_FILE_HEADER_SIZE] = {'P', 'R', 'I', 'M', 'E', 'S', 0, PRIME_FILE_VERSION};
+
+PrimeWriter::PrimeWriter(std::ostream& out, bool header)
+	: mOut(out) {
+	mBuffer.reserve(PRIME_FILE_BUFFER);
+	if (header)
+		mBuffer.insert(mBuffer.end(), prime_file_magic, prime_file_magic + sizeof(prime_file_magic));
+}
+
+PrimeWriter::~PrimeWriter() {
+	flush();
+}
+
+void PrimeWriter::run(const mpz_class& base, const uint32_t* offsets, size_t count) {
+	if (count == 0)
+		return;
+	put_varint(count);
+	size_t size = (mpz_sizeinbase(base.get_mpz_t(), 2) + 7) / 8;
+	mMagnitude.resize(size);
+	size_t written = 0;
+	mpz_export(mMagnitude.data(), &written, -1, 1, 0, 0, base.get_mpz_t());
+	put_varint((uint64_t) written << 1 | (mpz_sgn(base.get_mpz_t()) < 0));
+	mBuffer.insert(mBuffer.end(), mMagnitude.begin(), mMagnitude.begin() + written);
+	uint32_t previous = 0;
+	for (size_t i = 0; i < count; i++) {
+		put_varint(offsets[i] - previous);
+		previous = offsets[i];
+		if (mBuffer.size() >= PRIME_FILE_BUFFER)
+			flush();
+	}
+}
+
+void PrimeWriter::flush() {
+	mOut.write(mBuffer.data(), mBuffer.size());
+	mOut.flush();
+	mBuffer.clear();
+}
+
+PrimeReader::PrimeReader(std::istream& in)
+	: mIn(in)
+	, mBuffer(PRIME_FILE_BUFFER)
+	, mPos(0)
+	, mSize(0)
+	, mLeft(0)
+	, mOk(true) {
+	unsigned char header[sizeof(prime_file_magic)];
+	for (size_t i = 0; i < sizeof(header) && mOk; i++)
+		mOk = get_byte(&header[i]);
+	mOk = mOk && memcmp(header, prime_file_magic, sizeof(header)) == 0;
+}
+
+bool PrimeReader::fill() {
+	if (mPos == mSize) {
+		mIn.read(mBuffer.data(), mBuffer.size());
+		mSize = mIn.gcount();
+		mPos = 0;
+	}
+	return mPos < mSize;
+}
+
+bool PrimeReader::get_byte(unsigned char* byte) {
+	if (!fill())
+		return false;
+	*byte = mBuffer[mPos++];
+	return true;
+}
+
+bool PrimeReader::get_varint(uint64_t* value) {
+	*value = 0;
+	unsigned char byte;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (!get_byte(&byte))
+			return false;
+		*value |= (uint64_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool PrimeReader::next(mpz_class* prime) {
+	if (!mOk)
+		return false;
+	uint64_t value;
+	if (mLeft == 0) {
+		// The file may only end between two runs
+		if (!fill())
+			return false;
+		uint64_t size;
+		if (!get_varint(&mLeft) || mLeft == 0 || !get_varint(&size) || (size >> 1) > PRIME_FILE_MAX_MAGNITUDE) {
+			mOk = false;
+			return false;
+		}
+		mMagnitude.resize(size >> 1);
+		for (size_t i = 0; i < mMagnitude.size(); i++) {
+			if (!get_byte(&mMagnitude[i])) {
+				mOk = false;
+				return false;
+			}
+		}
+		mpz_import(mValue.get_mpz_t(), mMagnitude.size(), -1, 1, 0, 0, mMagnitude.data());
+		if (size & 1)
+			mpz_neg(mValue.get_mpz_t(), mValue.get_mpz_t());
+	}
+	if (!get_varint(&value)) {
+		mOk = false;
+		return false;
+	}
+	mpz_add_ui(mValue.get_mpz_t(), mValue.get_mpz_t(), value);
+	mLeft--;
+	*prime = mValue;
+	return true;
+}
@@ -0,0 +1,131 @@
+#ifndef PRIME_FILE_HPP
+#define PRIME_FILE_HPP
+
+/*
+ * Compact binary format for the found primes, instead of one decimal number per prime. The primes
+ * of an interval share all but their last digits, so they are stored as runs: a run header holding
+ * the base of the run (lower bound of the interval or piece), then the gap of each prime to the
+ * previous one (the first one to the base) as a varint. A 100 digits prime takes about 2 bytes
+ * instead of 101, and writing it needs no conversion to base 10.
+ *
+ * Layout, every integer being an unsigned LEB128 varint:
+ * "PRIMES" 0 PRIME_FILE_VERSION  file header, 8 bytes
+ * then runs until the end of the file:
+ *   count                       number of primes of the run (not null)
+ *   (size << 1) | negative      size in bytes of the magnitude of the base, and its sign
+ *   magnitude                   `size` bytes, least significant first, at most
+ *                               PRIME_FILE_MAX_MAGNITUDE
+ *   gap * count                 prime - previous prime, the first prime minus the base
+ */
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <stdint.h>
+#include <gmpxx.h>
+
+#define PRIME_FILE_VERSION 1
+// Size in bytes of the file header
+#define PRIME_FILE_HEADER_SIZE 8
+// Bytes buffered by `PrimeWriter` and `PrimeReader` between two calls to the stream
+#define PRIME_FILE_BUFFER (1 << 16)
+// Largest magnitude of a base in bytes (32768 bits), a larger size is taken for a corrupted file
+#define PRIME_FILE_MAX_MAGNITUDE (1 << 12)
+
+class PrimeWriter {
+public:
+	/*
+	* Write the file header on `out`, the stream must be kept open until the writer is destroyed.
+	* header : false to append runs to a file which already has its header.
+	*/
+	PrimeWriter(std::ostream& out, bool header = true);
+
+	/*
+	* Flush the buffered runs.
+	*/
+	~PrimeWriter();
+
+	PrimeWriter(const PrimeWriter&) = delete;
+	PrimeWriter& operator=(const PrimeWriter&) = delete;
+
+	/*
+	* Add a run of primes after the previous runs.
+	* base : base of the run.
+	* offsets : ascending offsets of the primes from `base`.
+	* count : number of primes, nothing is written if null.
+	*/
+	void run(const mpz_class& base, const uint32_t* offsets, size_t count);
+
+	// Write the buffered runs on the stream and flush it
+	void flush();
+
+private:
+	inline void put_varint(uint64_t value) {
+		while (value >= 0x80) {
+			mBuffer.push_back((char) (value | 0x80));
+			value >>= 7;
+		}
+		mBuffer.push_back((char) value);
+	}
+
+	std::ostream& mOut;
+	std::vector<char> mBuffer;
+	std::vector<unsigned char> mMagnitude; //! bytes of the base being written
+};
+
+/*
+* Lazy reader of a prime file: each call to `next` decodes a single prime from a buffer of the
+* stream, so files of any size are iterated in constant memory.
+*/
+class PrimeReader {
+public:
+	/*
+	* Read the file header from `in`, `ok` is false if it is not a prime file.
+	*/
+	PrimeReader(std::istream& in);
+
+	PrimeReader(const PrimeReader&) = delete;
+	PrimeReader& operator=(const PrimeReader&) = delete;
+
+	/*
+	* Decode the next prime into `prime`.
+	* return : false at the end of the file, or if the file is truncated or malformed (see `ok`).
+	*/
+	bool next(mpz_class* prime);
+
+	// False if the header is wrong or the file ends in the middle of a run
+	inline bool ok() const {
+		return mOk;
+	}
+
+private:
+	// Read the stream into the buffer if it is consumed, false at the end of the stream
+	bool fill();
+	bool get_byte(unsigned char* byte);
+	bool get_varint(uint64_t* value);
+
+	std::istream& mIn;
+	std::vector<char> mBuffer;
+	size_t mPos;	   //! next byte of mBuffer to decode
+	size_t mSize;	   //! bytes of mBuffer read from the stream
+	uint64_t mLeft;	   //! primes left in the current run
+	mpz_class mValue;  //! last decoded prime, or base of the current run
+	std::vector<unsigned char> mMagnitude;
+	bool mOk;
+};
+
+/*
+* Call `on_prime(prime)` for every prime of the file `in`, in order, decoding them one at a time.
+* return : false if the file is not a prime file or is truncated.
+*/
+template <typename F>
+bool prime_file_for_each(std::istream& in, F on_prime) {
+	PrimeReader reader(in);
+	mpz_class prime;
+	while (reader.next(&prime))
+		on_prime(prime);
+	return reader.ok();
+}
+
+#endif //! PRIME_FILE_HPP
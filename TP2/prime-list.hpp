@@ -0,0 +1,126 @@
+#ifndef PRIME_LIST_HPP
+#define PRIME_LIST_HPP
+
+/*
+ * Compact list of ascending likely primes. Primes of an interval share all but their last digits,
+ * so they are stored as runs: one `mpz_class` base per run and a 32 bits offset from that base per
+ * prime, instead of one `mpz_class` (and its heap limbs) per prime. Full values are rebuilt one at a
+ * time when the list is iterated.
+ */
+
+#include <iterator>
+#include <vector>
+#include <stdint.h>
+#include <gmpxx.h>
+
+class ResultMerge;
+
+class PrimeList {
+public:
+	/*
+	* Append `prime`, greater than every prime of the list. A new run is started when the offset from
+	* the base of the last run does not fit in 32 bits.
+	*/
+	void push(const mpz_class& prime);
+
+	/*
+	* Append the runs of `other`, whose primes are all greater than the primes of the list.
+	*/
+	void append(const PrimeList* other);
+
+	// Number of primes
+	inline size_t size() const {
+		return mOffsets.size();
+	}
+
+	// Number of runs
+	inline size_t runs() const {
+		return mBases.size();
+	}
+
+	// Base, number of primes and offsets of a run, for writers storing the runs as they are
+	inline const mpz_class& run_base(size_t run) const {
+		return mBases[run];
+	}
+	inline size_t run_size(size_t run) const {
+		return mEnds[run] - (run > 0 ? mEnds[run - 1] : 0);
+	}
+	inline const uint32_t* run_offsets(size_t run) const {
+		return mOffsets.data() + (run > 0 ? mEnds[run - 1] : 0);
+	}
+
+	// Bytes used by the list, heap included
+	size_t memory() const;
+
+	/*
+	* Forward iterator rebuilding each prime from its run base and offset into a value of its own,
+	* so it needs no allocation per prime.
+	*/
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef mpz_class value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const mpz_class* pointer;
+		typedef const mpz_class& reference;
+
+		inline const mpz_class& operator*() const {
+			return mValue;
+		}
+		inline const mpz_class* operator->() const {
+			return &mValue;
+		}
+		inline iterator& operator++() {
+			mIndex++;
+			load();
+			return *this;
+		}
+		inline bool operator==(const iterator& other) const {
+			return mIndex == other.mIndex;
+		}
+		inline bool operator!=(const iterator& other) const {
+			return mIndex != other.mIndex;
+		}
+
+	private:
+		friend class PrimeList;
+
+		iterator(const PrimeList* list, size_t index)
+			: mList(list)
+			, mRun(0)
+			, mIndex(index) {
+			load();
+		}
+
+		// Rebuild the value at mIndex
+		inline void load() {
+			if (mIndex >= mList->size())
+				return;
+			while (mList->mEnds[mRun] <= mIndex)
+				mRun++;
+			mpz_add_ui(mValue.get_mpz_t(), mList->mBases[mRun].get_mpz_t(), mList->mOffsets[mIndex]);
+		}
+
+		const PrimeList* mList;
+		size_t mRun;
+		size_t mIndex;
+		mpz_class mValue;
+	};
+
+	inline iterator begin() const {
+		return iterator(this, 0);
+	}
+	inline iterator end() const {
+		return iterator(this, size());
+	}
+
+private:
+	friend class ResultMerge;
+
+	std::vector<mpz_class> mBases;	//! first value of each run (not necessarily a prime)
+	std::vector<size_t> mEnds;		//! index in mOffsets after the last prime of each run
+	std::vector<uint32_t> mOffsets; //! offset of each prime from the base of its run
+	mpz_class mScratch;				//! difference computed by `push`
+};
+
+#endif //! PRIME_LIST_HPP
@@ -0,0 +1,380 @@
+/*!
+ * \file prime-mpi.cpp
+ * \brief MPI program to find every likely primes in big values intervals on several nodes.
+ * \author Vincent Commin & Louis Leenart
+ *
+ * Rank 0 (the master) reads and merges the intervals, cuts them into chunks of about the same
+ * expected cost (see `cost_model`), then hands the chunks out on demand: a worker gets a new chunk
+ * each time it sends back the primes of one, so fast nodes take more chunks than slow ones. Every
+ * other rank (a worker) scans its chunks with the OpenMP kernel of the threaded program
+ * (`compute_prime`) and sends their primes back in the binary format of prime-file.hpp. The master
+ * writes the primes of the chunks in order as soon as they are complete.
+ *
+ * usage: mpirun -np <nb_ranks> prime-mpi <nb_threads> <filepath> [rounds] [--sieve=<bound>]
+ * [--stats] [--test=mr|fixed|bpsw] [--seed=<seed>] [--format=text|binary]
+ */
+
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gmpxx.h>
+#include <mpi.h>
+#include <omp.h>
+
+#include "Chrono.hpp"
+#include "cost-model.hpp"
+#include "interval-reader.hpp"
+#include "miller-rabin-gmp.hpp"
+#include "prime-file.hpp"
+#include "prime-list.hpp"
+#include "prime-search.hpp"
+#include "sieve.hpp"
+
+// Message tags, a chunk to scan, the end of the run, the primes of a chunk
+#define PRIME_MPI_TAG_CHUNK 1
+#define PRIME_MPI_TAG_STOP 2
+#define PRIME_MPI_TAG_RESULT 3
+// Chunks per worker the intervals are cut into, more chunks balance the load better but cost more
+// messages
+#define PRIME_MPI_CHUNKS_PER_WORKER 16
+// Chunks sent to a worker ahead of the one it scans, so it does not wait for the master between two
+// chunks
+#define PRIME_MPI_PREFETCH 2
+// Chunks handed out ahead of the next one to write, per worker. Bounds the primes kept by the master
+// while a slow chunk is late
+#define PRIME_MPI_WINDOW 8
+
+/*
+* Cut the intervals into chunks of about the same expected cost, long intervals being cut and short
+* ones grouped.
+* intervals : sorted and not overlapping (see `merge_intervals`).
+* nb_chunks : number of chunks aimed at.
+* model : expected cost of the intervals.
+*
+* return : bounds of each chunk [lower_bound1, upper_bound1, ...], in ascending order. Property of
+* caller.
+*/
+std::vector<std::vector<mpz_class>>* split_chunks(const std::vector<std::pair<mpz_class, mpz_class>>* intervals, size_t nb_chunks, const cost_model* model) {
+	double total = 0;
+	for (const std::pair<mpz_class, mpz_class>& pair : *intervals)
+		total += cost_model_estimate(model, pair.first, pair.second);
+	double target = total / nb_chunks;
+	std::vector<std::vector<mpz_class>>* chunks = new std::vector<std::vector<mpz_class>>(1);
+	// Cost left to the chunk being filled
+	double budget = target;
+	for (const std::pair<mpz_class, mpz_class>& pair : *intervals) {
+		mpz_class from = pair.first;
+		while (from < pair.second) {
+			mpz_class to = pair.second;
+			double cost = cost_model_estimate(model, from, to);
+			if (cost > budget && target > 0) {
+				// Cut the interval where its cost fills the chunk, the cost being about linear in
+				// the length at a given bit size
+				mpz_class length = to - from;
+				to = from + mpz_class(length.get_d() * (budget / cost));
+				if (to <= from)
+					to = from + 1;
+				budget = 0;
+			} else {
+				budget -= cost;
+			}
+			chunks->back().push_back(from);
+			chunks->back().push_back(to);
+			if (budget <= 0 && target > 0) {
+				chunks->emplace_back();
+				budget = target;
+			}
+			from = to;
+		}
+	}
+	if (chunks->back().empty())
+		chunks->pop_back();
+	return chunks; // Property of caller
+}
+
+/*
+* Message of a chunk : its sequence number, then its bounds in hexadecimal.
+*/
+std::string chunk_pack(uint64_t seq, const std::vector<mpz_class>& bounds) {
+	std::string message = std::to_string(seq);
+	for (const mpz_class& bound : bounds) {
+		message += ' ';
+		message += bound.get_str(16);
+	}
+	return message;
+}
+
+/*
+* Find every likely prime of a chunk on the threads of this rank.
+* message : chunk, see `chunk_pack`.
+* stats : sieve counters of the rank.
+*
+* return : message of the primes of the chunk : its sequence number (8 bytes, host order, the
+* ranks being alike), then the primes in the binary format of prime-file.hpp.
+*/
+std::string chunk_scan(const std::string& message, int nb_threads, int rounds, const std::vector<uint32_t>* sieve_primes, sieve_stats* stats, uint64_t seed) {
+	std::istringstream in(message);
+	uint64_t seq = 0;
+	in >> seq;
+	std::vector<std::pair<mpz_class, mpz_class>> intervals;
+	std::string from, to;
+	while (in >> from >> to)
+		intervals.emplace_back(mpz_class(from, 16), mpz_class(to, 16));
+	// The chunk is a single piece of work, its intervals are dealt round robin then stolen
+	PrimeList* primes = compute_prime(&intervals, rounds, nb_threads, sieve_primes, NULL, stats, seed);
+	std::ostringstream out;
+	out.write((const char*) &seq, sizeof(seq));
+	{
+		PrimeWriter writer(out);
+		for (size_t run = 0; run < primes->runs(); run++)
+			writer.run(primes->run_base(run), primes->run_offsets(run), primes->run_size(run));
+	}
+	delete(primes);
+	return out.str();
+}
+
+/*
+* Write the primes of a chunk on the standard output.
+* result : message of the primes, see `chunk_scan`.
+* binary : write the runs as they are, the file header being already written, decimal otherwise.
+*/
+void chunk_write(const std::string& result, bool binary) {
+	size_t skip = sizeof(uint64_t) + PRIME_FILE_HEADER_SIZE;
+	if (binary) {
+		std::cout.write(result.data() + skip, result.size() - skip);
+		return;
+	}
+	std::istringstream in(result.substr(sizeof(uint64_t)));
+	prime_file_for_each(in, [](const mpz_class& prime) {
+		std::cout << prime << '\n';
+	});
+}
+
+/*
+* Receive the next message sent to this rank by `source` with `tag` (or any of them).
+* return : the status of the message, its content is in `message`.
+*/
+MPI_Status receive(int source, int tag, std::string* message) {
+	MPI_Status status;
+	MPI_Probe(source, tag, MPI_COMM_WORLD, &status);
+	int size;
+	MPI_Get_count(&status, MPI_CHAR, &size);
+	std::vector<char> buffer(size);
+	MPI_Recv(buffer.data(), size, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	message->assign(buffer.begin(), buffer.end());
+	return status;
+}
+
+/*
+* Hand the chunks out to the workers on demand and write their primes in order, then stop the
+* workers.
+* chunks : messages of the chunks (see `chunk_pack`), in ascending order.
+* nb_workers : number of workers, ranks 1 to `nb_workers`.
+* binary : see `chunk_write`.
+*
+* return : largest number of chunks done but not written yet.
+*/
+size_t master(const std::vector<std::string>& chunks, int nb_workers, bool binary) {
+	// Next chunk to hand out, and to write
+	size_t next_chunk = 0;
+	size_t next_write = 0;
+	size_t window = (size_t) nb_workers * PRIME_MPI_WINDOW;
+	std::vector<int> outstanding(nb_workers + 1, 0);
+	// Chunks done but not written yet, by sequence number
+	std::map<uint64_t, std::string> done;
+	size_t peak = 0;
+	// Sends of the chunks, never waited for while a worker may be sending a result: a large chunk
+	// would wait for a worker itself waiting for the master to take its result. The buffers are the
+	// `chunks`, kept until the end
+	std::vector<MPI_Request> sending;
+
+	// Top the chunks sent ahead to every worker up to PRIME_MPI_PREFETCH, within the window
+	auto deal = [&]() {
+		for (int worker = 1; worker <= nb_workers; worker++) {
+			while (outstanding[worker] < PRIME_MPI_PREFETCH && next_chunk < chunks.size() && next_chunk < next_write + window) {
+				const std::string& chunk = chunks[next_chunk++];
+				sending.emplace_back();
+				MPI_Isend(chunk.data(), chunk.size(), MPI_CHAR, worker, PRIME_MPI_TAG_CHUNK, MPI_COMM_WORLD, &sending.back());
+				outstanding[worker]++;
+			}
+		}
+	};
+	deal();
+	std::string result;
+	while (next_write < chunks.size()) {
+		MPI_Status status = receive(MPI_ANY_SOURCE, PRIME_MPI_TAG_RESULT, &result);
+		outstanding[status.MPI_SOURCE]--;
+		uint64_t seq;
+		memcpy(&seq, result.data(), sizeof(seq));
+		done[seq] = std::move(result);
+		peak = std::max(peak, done.size());
+		// Write every chunk complete up to the first one still scanned
+		for (auto it = done.find(next_write); it != done.end(); it = done.find(next_write)) {
+			chunk_write(it->second, binary);
+			done.erase(it);
+			next_write++;
+		}
+		deal();
+	}
+	// Every chunk is scanned, so every one was received
+	MPI_Waitall(sending.size(), sending.data(), MPI_STATUSES_IGNORE);
+	for (int worker = 1; worker <= nb_workers; worker++)
+		MPI_Send(NULL, 0, MPI_CHAR, worker, PRIME_MPI_TAG_STOP, MPI_COMM_WORLD);
+	return peak;
+}
+
+/*
+* Scan the chunks sent by the master until it stops this rank.
+* stats : sieve counters of the rank.
+*/
+void worker(int nb_threads, int rounds, const std::vector<uint32_t>* sieve_primes, sieve_stats* stats, uint64_t seed) {
+	std::string chunk;
+	while (receive(0, MPI_ANY_TAG, &chunk).MPI_TAG == PRIME_MPI_TAG_CHUNK) {
+		std::string result = chunk_scan(chunk, nb_threads, rounds, sieve_primes, stats, seed);
+		MPI_Send(result.data(), result.size(), MPI_CHAR, 0, PRIME_MPI_TAG_RESULT, MPI_COMM_WORLD);
+	}
+}
+
+/*
+* Read and merge the intervals of the file `path`, each thread parsing a part of it.
+* return : merged intervals, NULL if the file can't be read or is malformed. Property of caller.
+*/
+std::vector<std::pair<mpz_class, mpz_class>>* read_intervals(const char* path, int nb_threads) {
+	IntervalReader reader(path, nb_threads);
+	if (!reader.is_open()) {
+		std::cerr << "error: can\'t open file at : " << path << std::endl;
+		return NULL;
+	}
+	#pragma omp parallel for num_threads(nb_threads) schedule(static)
+	for (int part = 0; part < reader.parts(); part++)
+		reader.parse(part);
+	std::vector<mpz_class> * values = reader.values();
+	if (values == NULL) {
+		std::cerr << "error: malformed interval file : " << path << std::endl;
+		return NULL;
+	}
+	std::vector<std::pair<mpz_class, mpz_class>> intervals;
+	intervals.reserve(values->size() / 2);
+	for (size_t i = 0; i < values->size(); i += 2)
+		intervals.emplace_back(std::move(values->at(i)), std::move(values->at(i + 1)));
+	delete(values);
+	return merge_intervals(&intervals); // Property of caller
+}
+
+int main(int argc, char** argv) {
+	// Parse args, every rank gets the same ones
+	if (argc < 3) {
+		std::cerr << "usage: mpirun -np <nb_ranks> prime-mpi <nb_threads> <filepath> [rounds] [--sieve=<bound>] [--stats] [--test=mr|fixed|bpsw] [--seed=<seed>] [--format=text|binary]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	unsigned int rounds = 5;
+	unsigned int nb_thread = atoi(argv[1]);
+	// Upper bound of the small primes used to sieve the intervals (0 to disable the sieve)
+	uint32_t sieve_bound = SIEVE_DEFAULT_BOUND;
+	// Print the counters on the error output
+	bool print_stats = false;
+	// Primality test of the values larger than 64 bits
+	prime_test test = PRIME_TEST_MR_RANDOM;
+	// Seed of the miller-rabin witnesses, the one of rank 0 is used by every rank
+	uint64_t seed = time(NULL);
+	// Write the primes in the binary format of prime-file.hpp instead of decimal
+	bool binary = false;
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.rfind("--sieve=", 0) == 0)
+			sieve_bound = std::stoul(arg.substr(8));
+		else if (arg == "--stats")
+			print_stats = true;
+		else if (arg.rfind("--seed=", 0) == 0)
+			seed = std::stoull(arg.substr(7));
+		else if (arg.rfind("--format=", 0) == 0) {
+			if (arg != "--format=text" && arg != "--format=binary") {
+				std::cerr << "error: unknown output format : " << arg.substr(9) << std::endl;
+				return EXIT_FAILURE;
+			}
+			binary = arg == "--format=binary";
+		}
+		else if (arg.rfind("--test=", 0) == 0) {
+			if (!prime_test_parse(arg.substr(7), &test)) {
+				std::cerr << "error: unknown primality test : " << arg.substr(7) << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else
+			rounds = atoi(argv[i]);
+	}
+	prob_prime_set_test(test);
+
+	// Only the main thread of a rank calls MPI, between the parallel regions
+	int provided;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	int rank, size;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+	MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+	// Each rank draws its witnesses from its own streams
+	uint64_t rank_seed = witness_rng_mix(seed + rank * WITNESS_RNG_GAMMA);
+	std::vector<uint32_t> * sieve_primes = small_primes(sieve_bound);
+	sieve_stats stats{};
+	int status = EXIT_SUCCESS;
+
+	if (rank == 0) {
+		int nb_workers = size - 1;
+		std::vector<std::pair<mpz_class, mpz_class>> * merged = read_intervals(argv[2], nb_thread);
+		std::vector<std::string> chunks;
+		if (merged != NULL) {
+			// Expected cost of the intervals
+			cost_model * model = cost_model_calibrate(rounds, sieve_primes);
+			std::vector<std::vector<mpz_class>> * bounds = split_chunks(merged, (size_t) std::max(nb_workers, 1) * PRIME_MPI_CHUNKS_PER_WORKER, model);
+			for (size_t seq = 0; seq < bounds->size(); seq++)
+				chunks.push_back(chunk_pack(seq, bounds->at(seq)));
+			delete(bounds);
+			delete(model);
+			delete(merged);
+		} else {
+			status = EXIT_FAILURE;
+		}
+		// Compute time, output included
+		Chrono c(true);
+		if (binary && status == EXIT_SUCCESS) {
+			// File header only, the runs of the chunks are copied after it
+			PrimeWriter header(std::cout);
+		}
+		size_t peak = 0;
+		if (nb_workers > 0) {
+			// Workers are stopped even if there is nothing to scan
+			peak = master(chunks, nb_workers, binary);
+		} else {
+			// A single rank scans its chunks itself
+			for (const std::string& chunk : chunks)
+				chunk_write(chunk_scan(chunk, nb_thread, rounds, sieve_primes, &stats, rank_seed), binary);
+		}
+		std::cout.flush();
+		c.pause();
+		// Counters of every rank
+		sieve_stats total{};
+		MPI_Reduce(&stats.candidates, &total.candidates, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&stats.survivors, &total.survivors, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+		if (status == EXIT_SUCCESS) {
+			std::cerr << c.get() << std::endl;
+			if (print_stats) {
+				std::cerr << "seed: " << seed << std::endl;
+				sieve_stats_print(&total);
+				std::cerr << "mpi: " << chunks.size() << " chunks on " << nb_workers << " workers, at most " << peak << " chunks buffered" << std::endl;
+			}
+		}
+	} else {
+		worker(nb_thread, rounds, sieve_primes, &stats, rank_seed);
+		MPI_Reduce(&stats.candidates, NULL, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&stats.survivors, NULL, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	}
+
+	delete(sieve_primes);
+	MPI_Finalize();
+	return status;
+}
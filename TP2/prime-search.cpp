@@ -0,0 +1,105 @@
+/*
+ * Batch search of the likely primes of a set of intervals, see prime-search.hpp.
+ */
+
+#include <algorithm>
+
+#include <omp.h>
+
+#include "miller-rabin-gmp.hpp"
+#include "prime-search.hpp"
+#include "result-buffer.hpp"
+#include "scan.hpp"
+#include "steal-scheduler.hpp"
+
+/*
+* Encapsulation comparaison operator for pair of mpz_class. Used for std::sort.
+*/
+bool comp_pair(std::pair<mpz_class, mpz_class> a, std::pair<mpz_class, mpz_class> b) { 
+	return a.first < b.first;
+}
+
+/*
+* Merge pair of mpz_class as intervals, to reduce overlapping and to not check if a number is prime
+* multiples times.
+*
+* result pointer is property of caller
+*/
+std::vector<std::pair<mpz_class, mpz_class>>* merge_intervals(std::vector<std::pair<mpz_class, mpz_class>>* intervals) {
+	// Sort array by first element of pairs
+	std::sort(intervals->begin(), intervals->end(), comp_pair);
+	std::vector<std::pair<mpz_class, mpz_class>> *merged = new std::vector<std::pair<mpz_class, mpz_class>>();
+	
+	for (std::pair<mpz_class, mpz_class> pair : *intervals) {
+		// if the list of merged intervals is empty or if the current interval does not overlap with
+		// the previous interval, append it.
+		if (merged->empty() || (merged->back().second < pair.first)) {
+			merged->push_back(pair);
+		} else {
+			// there is overlap, so we merge the current and previous intervals.
+			merged->back().second = std::max(merged->back().second, pair.second);
+		}
+	}
+	return merged; // Property of caller
+}
+
+/* Find every likely prime value in the intervals, multi-threaded using openMP
+ * 
+ * rounds : number of passes of miller rabin algorithm. Higher means more precision and compute
+ * time.
+ * nb_threads : number of threads launched to compute. If openMP is not available, defaults as 1 thread.
+ * sieve_primes : small primes used to sieve the intervals before running miller rabin (see `small_primes`).
+ * model : expected cost of the intervals, used to deal them to the threads (see `StealScheduler::plan`).
+ * May be NULL, intervals are then dealt round robin.
+ * stats : sieve counters, incremented by every thread.
+ * seed : seed of the miller-rabin witnesses, each thread draws from the stream of its number.
+ * 
+ * result : list of found likely primes in intervals, in ascending order. Property of caller.
+ *
+ * Intervals (sorted and not overlapping, see `merge_intervals`) are dealt to the threads of the parallel region, which split and steal them from each
+ * other (see `StealScheduler`), so a long interval is shared by every thread once the others are
+ * done instead of being scanned by a single iteration of a parallel for.
+*/
+PrimeList* compute_prime(std::vector<std::pair<mpz_class, mpz_class>> * intervals, int rounds, int nb_threads, const std::vector<uint32_t> * sieve_primes, const cost_model * model, sieve_stats * stats, uint64_t seed) {
+	// Result buffers, one per thread, each thread only writes its own
+	std::vector<result_buffer> results(nb_threads);
+	omp_set_num_threads(nb_threads);
+	StealScheduler scheduler(nb_threads);
+	for (const std::pair<mpz_class, mpz_class>& pair : *intervals)
+		scheduler.add_interval(pair.first, pair.second);
+	if (model != NULL)
+		scheduler.plan(model);
+	// Start parallel region, each thread takes pieces until there is no work left
+	#pragma omp parallel shared(results, scheduler, rounds, sieve_primes, stats)
+	{
+		// Found primes, a run per piece
+		result_buffer* buffer = &results[omp_get_thread_num()];
+		sieve_stats local_stats{};
+		witness_rng rng;
+		witness_rng_init(&rng, seed, omp_get_thread_num());
+		mpz_class from, to;
+		steal_range piece;
+		// The region may get less threads than requested, they still find the work of the others
+		while (scheduler.next(omp_get_thread_num(), &piece)) {
+			const mpz_class& base = scheduler.base(piece.slice);
+			mpz_add_ui(from.get_mpz_t(), base.get_mpz_t(), piece.begin);
+			mpz_add_ui(to.get_mpz_t(), base.get_mpz_t(), piece.end);
+			// Iterates through every item of the piece
+			result_buffer_start(buffer, piece.slice, piece.begin, from);
+			scan_interval(from, to, rounds, &rng, sieve_primes, &local_stats, [&](const mpz_class& item) {
+				result_buffer_push(buffer, item); // Add found prime in the local buffer
+			});
+		}
+		#pragma omp atomic
+		stats->candidates += local_stats.candidates;
+		#pragma omp atomic
+		stats->survivors += local_stats.survivors;
+	}
+
+	// Runs of every thread in interval order, each thread moving a part of the primes
+	PrimeList* primes = new PrimeList();
+	ResultMerge merge(&results, &scheduler.bases(), primes);
+	#pragma omp parallel shared(merge)
+	merge.move(omp_get_thread_num(), omp_get_num_threads());
+	return primes;
+}
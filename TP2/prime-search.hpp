@@ -0,0 +1,22 @@
+#ifndef PRIME_SEARCH_HPP
+#define PRIME_SEARCH_HPP
+
+/*
+ * Batch search of the likely primes of a set of intervals on the threads of a node, shared by the
+ * threaded program (main.cpp) and the workers of the MPI program (prime-mpi.cpp).
+ */
+
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "cost-model.hpp"
+#include "prime-list.hpp"
+#include "sieve.hpp"
+
+std::vector<std::pair<mpz_class, mpz_class>>* merge_intervals(std::vector<std::pair<mpz_class, mpz_class>>* intervals);
+PrimeList* compute_prime(std::vector<std::pair<mpz_class, mpz_class>> * intervals, int rounds, int nb_threads, const std::vector<uint32_t> * sieve_primes, const cost_model * model, sieve_stats * stats, uint64_t seed);
+
+#endif //! PRIME_SEARCH_HPP
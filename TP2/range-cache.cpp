@@ -0,0 +1,177 @@
+/*
+ * On-disk cache of the scanned ranges, see range-cache.hpp.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "range-cache.hpp"
+
+RangeCache::RangeCache(const std::string& dir, prime_test test, size_t rounds)
+	: mDir(dir)
+	, mTest(prime_test_name(test))
+	, mRounds(prob_prime_mr_rounds(rounds))
+	, mOpen(false)
+	, mNextFile(0)
+	, mReadEntry(-1)
+	, mReadPending(false) {
+	mkdir(dir.c_str(), 0755);
+	struct stat st;
+	if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+		return;
+	mOpen = true;
+
+	std::ifstream index(mDir + "/" + RANGE_CACHE_INDEX);
+	std::string line;
+	while (getline(index, line)) {
+		mNextFile++;
+		std::istringstream iss(line);
+		std::string entry_test, from, to;
+		size_t entry_rounds;
+		cache_entry entry;
+		if (!(iss >> entry_test >> entry_rounds >> from >> to >> entry.file))
+			continue;
+		// Only results at least as reliable as the ones asked for
+		if (entry_test != mTest || entry_rounds < mRounds)
+			continue;
+		if (entry.from.set_str(from, 10) != 0 || entry.to.set_str(to, 10) != 0 || entry.to <= entry.from)
+			continue;
+		mEntries.push_back(std::move(entry));
+	}
+	std::sort(mEntries.begin(), mEntries.end(), [](const cache_entry& a, const cache_entry& b) {
+		return a.from < b.from;
+	});
+}
+
+std::vector<mpz_class>* RangeCache::gaps(const std::vector<mpz_class>* intervals) {
+	std::vector<mpz_class>* gaps = new std::vector<mpz_class>();
+	mSegments.clear();
+	mCached = 0;
+	mScanned = 0;
+	// Entries [0, next) start at or before `pos`, `reach` is the one of them ending last
+	size_t next = 0;
+	long reach = -1;
+	mpz_class pos, end;
+	for (size_t i = 0; i < intervals->size(); i += 2) {
+		pos = intervals->at(i);
+		const mpz_class& to = intervals->at(i + 1);
+		while (pos < to) {
+			while (next < mEntries.size() && mEntries[next].from <= pos) {
+				if (reach < 0 || mEntries[reach].to < mEntries[next].to)
+					reach = next;
+				next++;
+			}
+			if (reach >= 0 && pos < mEntries[reach].to) {
+				end = std::min(mEntries[reach].to, to);
+				mSegments.push_back({pos, end, reach});
+				mCached += end - pos;
+			} else {
+				end = next < mEntries.size() ? std::min(mEntries[next].from, to) : to;
+				mSegments.push_back({pos, end, -1});
+				gaps->push_back(pos);
+				gaps->push_back(end);
+				mScanned += end - pos;
+			}
+			pos = end;
+		}
+	}
+	return gaps; // property of caller
+}
+
+/*
+* Add the primes of the cache entry of `part` which are in `part` to `output`. The parts of an entry
+* come in ascending order, so the entry stays open and its next part goes on from the first prime
+* past this one: each file is decoded once whatever the number of parts taken from it.
+* return : false if the file of the entry is missing or truncated.
+*/
+bool RangeCache::splice_entry(const cache_segment& part, PrimeList* output) {
+	if (mReadEntry != part.entry) {
+		mReader.reset();
+		mReadFile.close();
+		mReadFile.clear();
+		mReadFile.open(mDir + "/" + mEntries[part.entry].file, std::ios::binary);
+		mReader.reset(new PrimeReader(mReadFile));
+		mReadEntry = part.entry;
+		mReadPending = false;
+	}
+	while (mReadPending || mReader->next(&mReadPrime)) {
+		mReadPending = false;
+		if (mReadPrime >= part.to) {
+			mReadPending = true;
+			return true;
+		}
+		if (mReadPrime >= part.from)
+			output->push(mReadPrime);
+	}
+	return mReader->ok();
+}
+
+/*
+* Add the primes of the gap to `output`, from `prime` which is moved past them, and store them in a
+* new entry of the cache. A gap which can't be stored is only added to the output.
+*/
+void RangeCache::splice_gap(const cache_segment& gap, PrimeList::iterator& prime, const PrimeList::iterator& end, PrimeList* output) {
+	// First file name not used yet
+	std::string name;
+	struct stat st;
+	do {
+		name = std::to_string(mNextFile++) + "-" + std::to_string(getpid()) + ".primes";
+	} while (stat((mDir + "/" + name).c_str(), &st) == 0);
+
+	std::ofstream file(mDir + "/" + name, std::ios::binary);
+	{
+		PrimeWriter writer(file);
+		// Primes are written as runs of 32 bits offsets from `base`
+		mpz_class base = gap.from;
+		mpz_class offset;
+		std::vector<uint32_t> offsets;
+		for (; prime != end && *prime < gap.to; ++prime) {
+			output->push(*prime);
+			offset = *prime - base;
+			if (!fits_u64(offset) || mpz_get_ui(offset.get_mpz_t()) > UINT32_MAX) {
+				writer.run(base, offsets.data(), offsets.size());
+				offsets.clear();
+				base = *prime;
+				offset = 0;
+			}
+			offsets.push_back(mpz_get_ui(offset.get_mpz_t()));
+		}
+		writer.run(base, offsets.data(), offsets.size());
+	}
+	file.close();
+	if (!file)
+		return;
+	std::ofstream index(mDir + "/" + RANGE_CACHE_INDEX, std::ios::app);
+	index << mTest << " " << mRounds << " " << gap.from << " " << gap.to << " " << name << std::endl;
+	// Usable by the next intervals of this run
+	if (index)
+		mEntries.push_back({gap.from, gap.to, name});
+}
+
+PrimeList* RangeCache::splice(const PrimeList* computed) {
+	PrimeList* output = new PrimeList();
+	PrimeList::iterator prime = computed->begin();
+	const PrimeList::iterator end = computed->end();
+	bool ok = true;
+	for (size_t i = 0; i < mSegments.size() && ok; i++) {
+		if (mSegments[i].entry >= 0)
+			ok = splice_entry(mSegments[i], output);
+		else
+			splice_gap(mSegments[i], prime, end, output);
+	}
+	mReader.reset();
+	mReadFile.close();
+	mReadEntry = -1;
+	if (!ok) {
+		delete(output);
+		return NULL;
+	}
+	std::sort(mEntries.begin(), mEntries.end(), [](const cache_entry& a, const cache_entry& b) {
+		return a.from < b.from;
+	});
+	return output; // property of caller
+}
@@ -0,0 +1,106 @@
+#ifndef RESULT_BUFFER_HPP
+#define RESULT_BUFFER_HPP
+
+/*
+ * Per worker result buffers. A worker scans pieces of the merged intervals in ascending order, so
+ * the primes of a piece form an ascending run. Runs are keyed by their position in the merged
+ * intervals (slice, then offset), so the sorted output is the concatenation of the runs of every
+ * worker in key order: no lock while scanning and no sort of big numbers at the end.
+ *
+ * Primes are kept as 32 bits offsets from the first value of their piece, pieces must hold less
+ * than 2^32 values.
+ */
+
+#include <vector>
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "prime-list.hpp"
+
+/*
+* Primes found in one piece.
+* slice : number of the slice (interval part) holding the piece, slices being numbered in ascending
+* order of their values.
+* begin : offset of the piece in the slice.
+* first : index of the first prime of the run in `result_buffer::offsets`.
+* count : number of primes of the run.
+*/
+struct result_run {
+	size_t slice;
+	uint64_t begin;
+	size_t first;
+	size_t count;
+};
+
+/*
+* Primes found by a worker.
+* offsets : offset of every prime found by the worker from the first value of its piece, run after
+* run.
+* runs : runs of `offsets`, in the order the pieces were processed.
+* base : first value of the current piece.
+* scratch : difference computed by `result_buffer_push`.
+*/
+struct result_buffer {
+	std::vector<uint32_t> offsets;
+	std::vector<result_run> runs;
+	mpz_class base;
+	mpz_class scratch;
+};
+
+/*
+* Start the run of the piece at `begin` in `slice`, the next values pushed belong to it.
+* from : first value of the piece (base of the slice + begin).
+*/
+inline void result_buffer_start(result_buffer* buffer, size_t slice, uint64_t begin, const mpz_class& from) {
+	buffer->runs.push_back({slice, begin, buffer->offsets.size(), 0});
+	buffer->base = from;
+}
+
+/*
+* Add a prime to the current run. Primes of a run must be pushed in ascending order.
+*/
+inline void result_buffer_push(result_buffer* buffer, const mpz_class& prime) {
+	mpz_sub(buffer->scratch.get_mpz_t(), prime.get_mpz_t(), buffer->base.get_mpz_t());
+	buffer->offsets.push_back(mpz_get_ui(buffer->scratch.get_mpz_t()));
+	buffer->runs.back().count++;
+}
+
+/*
+* K-way merge of the runs of several buffers into a `PrimeList`. The constructor orders the runs by
+* key and lays the list out, then `move` fills a part of the runs, so the parts can be filled by
+* different threads at once.
+*/
+class ResultMerge {
+public:
+	/*
+	* buffers : result buffers of the workers.
+	* bases : first value of each slice, by slice number.
+	* output : list receiving the primes, must be empty.
+	*/
+	ResultMerge(std::vector<result_buffer>* buffers, const std::vector<mpz_class>* bases, PrimeList* output);
+
+	/*
+	* Fill the runs [part * runs / nb_parts, (part + 1) * runs / nb_parts) of the output.
+	*/
+	void move(int part, int nb_parts);
+
+private:
+	/*
+	* A run and where it goes.
+	* buffer : index of the buffer holding the run.
+	* run : index of the run in the buffer.
+	* offset : position of the first value of the run in the output.
+	*/
+	struct placed_run {
+		size_t buffer;
+		size_t run;
+		size_t offset;
+	};
+
+	std::vector<result_buffer>* mBuffers;
+	const std::vector<mpz_class>* mSliceBases;
+	PrimeList* mOutput;
+	std::vector<placed_run> mRuns; //! every non empty run, in output order
+};
+
+#endif //! RESULT_BUFFER_HPP
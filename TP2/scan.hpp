@@ -0,0 +1,68 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+/*
+ * Interval scanning: sieve an interval then run the primality test on the survivors. This is the
+ * inner loop shared by every `compute_prime*` driver.
+ */
+
+#include <vector>
+#include <gmpxx.h>
+
+#include "miller-rabin-gmp.hpp"
+#include "sieve.hpp"
+
+// Number of sieve survivors handed at once to `prob_prime_batch`
+#define SCAN_BATCH_SIZE 64
+
+/*
+* Find every likely prime in [from, to) and call `on_prime(prime)` for each of them, in ascending
+* order.
+* Intervals fitting in 64 bits are routed to the exact 64 bits test (`prob_prime_u64`), without any
+* GMP arithmetic per candidate. Others go through the sieve, then the survivors are tested
+* SCAN_BATCH_SIZE at a time by `prob_prime_batch`.
+* rounds : number of miller-rabin rounds (unused for 64 bits intervals).
+* rng : random stream of the witnesses of miller-rabin.
+* sieve_primes : small primes used to sieve the interval.
+* stats : sieve counters.
+*/
+template <typename F>
+void scan_interval(const mpz_class& from,
+	const mpz_class& to,
+	size_t rounds,
+	witness_rng* rng,
+	const std::vector<uint32_t>* sieve_primes,
+	sieve_stats* stats,
+	F on_prime) {
+	if (fits_u64(from) && fits_u64(to)) {
+		mpz_class prime;
+		sieve_interval(mpz_get_ui(from.get_mpz_t()), mpz_get_ui(to.get_mpz_t()), sieve_primes, stats, [&](uint64_t candidate) {
+			if (prob_prime_u64(candidate)) {
+				mpz_set_ui(prime.get_mpz_t(), candidate);
+				on_prime(prime);
+			}
+		});
+		return;
+	}
+	// Size the Miller-Rabin buffers once for the whole interval
+	prob_prime_reserve(mpz_sizeinbase(to.get_mpz_t(), 2));
+	// Kept by the thread from one interval to the next, so its values are only allocated once
+	static thread_local std::vector<mpz_class> batch(SCAN_BATCH_SIZE);
+	bool results[SCAN_BATCH_SIZE];
+	size_t pending = 0;
+	auto flush = [&]() {
+		prob_prime_batch(batch.data(), pending, rounds, rng, results);
+		for (size_t i = 0; i < pending; i++)
+			if (results[i])
+				on_prime(batch[i]);
+		pending = 0;
+	};
+	sieve_interval(from, to, sieve_primes, stats, [&](const mpz_class& candidate) {
+		batch[pending++] = candidate;
+		if (pending == SCAN_BATCH_SIZE)
+			flush();
+	});
+	flush();
+}
+
+#endif //! SCAN_HPP
@@ -0,0 +1,98 @@
+/*
+ * Segmented small primes sieve, see sieve.hpp.
+ */
+
+#include <iostream>
+
+#include "sieve.hpp"
+
+/*
+* Returns every prime lower or equal to `bound`, in ascending order (Eratosthenes sieve).
+*
+* result pointer is property of caller
+*/
+std::vector<uint32_t>* small_primes(uint32_t bound) {
+	std::vector<uint32_t>* primes = new std::vector<uint32_t>();
+	if (bound < 2)
+		return primes;
+	std::vector<bool> composite(bound + 1, false);
+	for (uint64_t p = 2; p <= bound; p++) {
+		if (composite[p])
+			continue;
+		primes->push_back(p);
+		for (uint64_t m = p * p; m <= bound; m += p)
+			composite[m] = true;
+	}
+	return primes; // Property of caller
+}
+
+/*
+* Strike out of `seg->bits` every multiple of the small primes. `residue(p)` returns `base mod p`.
+* The small primes themselves are kept when the segment starts at `small_base` (UINT64_MAX if the
+* base is too big to contain a small prime), 0 being struck out as a multiple of every small prime.
+*/
+template <typename R>
+static void sieve_segment_strike(sieve_segment* seg, uint64_t small_base, const std::vector<uint32_t>* primes, sieve_stats* stats, R residue) {
+	size_t words = (seg->length + 63) / 64;
+	seg->bits.assign(words, ~0ULL);
+	if (seg->length % 64 != 0)
+		seg->bits[words - 1] = (1ULL << (seg->length % 64)) - 1;
+
+	for (uint32_t p : *primes) {
+		// Offset of the first multiple of p in the segment
+		uint64_t k = residue(p);
+		k = k == 0 ? 0 : p - k;
+		if (small_base == 0 && k == 0) {
+			seg->bits[0] &= ~1ULL;
+			k = p;
+		}
+		if (small_base + k == p)
+			k += p;
+		for (; k < seg->length; k += p)
+			seg->bits[k >> 6] &= ~(1ULL << (k & 63));
+	}
+
+	stats->candidates += seg->length;
+	for (uint64_t w : seg->bits)
+		stats->survivors += __builtin_popcountll(w);
+}
+
+/*
+* Sieve the segment [base, base + seg->length) with the small `primes`.
+* For each small prime `p`, `base mod p` is computed once, then every multiple of `p` in the segment
+* is struck out of `seg->bits`. The small primes themselves are kept.
+* stats : updated with the number of values covered and the number of survivors.
+*/
+void sieve_segment_fill(sieve_segment* seg, const mpz_class& base, const std::vector<uint32_t>* primes, sieve_stats* stats) {
+	// Only small bases can contain a small prime
+	uint64_t small_base = mpz_fits_ulong_p(base.get_mpz_t()) ? base.get_ui() : UINT64_MAX;
+	sieve_segment_strike(seg, small_base, primes, stats, [&](uint32_t p) { return mpz_fdiv_ui(base.get_mpz_t(), p); });
+}
+
+/*
+* Same as above for a 64 bits base.
+*/
+void sieve_segment_fill(sieve_segment* seg, uint64_t base, const std::vector<uint32_t>* primes, sieve_stats* stats) {
+	sieve_segment_strike(seg, base, primes, stats, [&](uint32_t p) { return base % p; });
+}
+
+/*
+* Same as above for a base of `limbs` 64 bits limbs, least significant first (see FixedUInt).
+*/
+void sieve_segment_fill(sieve_segment* seg, const uint64_t* base, size_t limbs, const std::vector<uint32_t>* primes, sieve_stats* stats) {
+	// Leading null limbs only slow the divisions down
+	while (limbs > 1 && base[limbs - 1] == 0)
+		limbs--;
+	// Only small bases can contain a small prime
+	uint64_t small_base = limbs == 1 ? base[0] : UINT64_MAX;
+	sieve_segment_strike(seg, small_base, primes, stats, [&](uint32_t p) { return mpn_mod_1(base, limbs, p); });
+}
+
+/*
+* Print the sieve counters on the error output.
+*/
+void sieve_stats_print(const sieve_stats* stats) {
+	double hit_rate = stats->candidates == 0 ? 0. : 100. * (stats->candidates - stats->survivors) / stats->candidates;
+	std::cerr << "sieve: " << stats->candidates << " candidates, " << stats->survivors << " tested, " << hit_rate << "% struck out"
+			  << std::endl;
+}
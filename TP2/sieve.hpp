@@ -0,0 +1,140 @@
+#ifndef SIEVE_HPP
+#define SIEVE_HPP
+
+/*
+ * Segmented small primes sieve. Strikes out every multiple of the small primes from an interval so
+ * only the survivors are handed to the (expensive) Miller-Rabin test.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <gmpxx.h>
+
+#include "fixed-uint.hpp"
+
+// Default upper bound of the small primes used to sieve the intervals. 0 disables the sieve.
+#define SIEVE_DEFAULT_BOUND 65536
+// Number of values covered by a single segment (one bit per value).
+#define SIEVE_SEGMENT_SIZE 32768
+
+/*
+* Sieve counters, used to report the hit rate of the sieve.
+* candidates : number of values covered by the sieve.
+* survivors : number of values not struck by the sieve, that is values tested by Miller-Rabin.
+*/
+struct sieve_stats {
+	uint64_t candidates;
+	uint64_t survivors;
+};
+
+/*
+* A chunk of an interval being sieved, starting at a base value given to `sieve_segment_fill`.
+* length : number of values in the segment, at most SIEVE_SEGMENT_SIZE.
+* bits : bit `k` is set if `base + k` has no small prime factor (or is itself a small prime).
+*/
+struct sieve_segment {
+	uint64_t length;
+	std::vector<uint64_t> bits;
+};
+
+std::vector<uint32_t>* small_primes(uint32_t bound);
+void sieve_segment_fill(sieve_segment* seg, const mpz_class& base, const std::vector<uint32_t>* primes, sieve_stats* stats);
+void sieve_segment_fill(sieve_segment* seg, uint64_t base, const std::vector<uint32_t>* primes, sieve_stats* stats);
+void sieve_segment_fill(sieve_segment* seg, const uint64_t* base, size_t limbs, const std::vector<uint32_t>* primes, sieve_stats* stats);
+void sieve_stats_print(const sieve_stats* stats);
+
+/*
+* Returns the offset of the first survivor at or after `k` in the segment, `seg->length` if there
+* is none.
+*/
+inline uint64_t sieve_segment_next(const sieve_segment* seg, uint64_t k) {
+	if (k >= seg->length)
+		return seg->length;
+	size_t word = k >> 6;
+	uint64_t bits = seg->bits[word] & (~0ULL << (k & 63));
+	while (bits == 0) {
+		if (++word == seg->bits.size())
+			return seg->length;
+		bits = seg->bits[word];
+	}
+	return (word << 6) + __builtin_ctzll(bits);
+}
+
+/*
+* `sieve_interval` for bounds of at most N limbs: the bases of the segments are walked as FixedUInt
+* values, and each survivor is copied into the value given to `on_survivor`, so there is no GMP
+* arithmetic per segment or per survivor.
+* return : false if a bound does not fit in N limbs, nothing is then sieved.
+*/
+template <size_t N, typename F>
+bool sieve_interval_fixed(const mpz_class& from, const mpz_class& to, const std::vector<uint32_t>* primes, sieve_stats* stats, F on_survivor) {
+	FixedUInt<N> base, end, candidate;
+	if (!base.set(from.get_mpz_t()) || !end.set(to.get_mpz_t()))
+		return false;
+	sieve_segment seg;
+	mpz_class value;
+	for (; base < end; base.add(seg.length)) {
+		uint64_t remaining = end.distance(base);
+		seg.length = remaining < SIEVE_SEGMENT_SIZE ? remaining : SIEVE_SEGMENT_SIZE;
+		sieve_segment_fill(&seg, base.limbs(), N, primes, stats);
+		for (uint64_t k = sieve_segment_next(&seg, 0); k < seg.length; k = sieve_segment_next(&seg, k + 1)) {
+			candidate = base;
+			candidate.add(k);
+			candidate.get(value.get_mpz_t());
+			on_survivor(value);
+		}
+	}
+	return true;
+}
+
+/*
+* Sieve the interval [from, to) segment by segment and call `on_survivor(candidate)` for each value
+* that survived, in ascending order.
+* Non negative bounds of at most FIXED_UINT_MAX_LIMBS limbs go through `sieve_interval_fixed`, the
+* limb count of the greater bound being rounded up to a power of 2 so that only a few sizes are
+* compiled.
+*/
+template <typename F>
+void sieve_interval(const mpz_class& from, const mpz_class& to, const std::vector<uint32_t>* primes, sieve_stats* stats, F on_survivor) {
+	if (from >= to)
+		return;
+	if (mpz_sgn(from.get_mpz_t()) >= 0) {
+		size_t limbs = std::max(mpz_size(from.get_mpz_t()), mpz_size(to.get_mpz_t()));
+		if (limbs <= 2 && sieve_interval_fixed<2>(from, to, primes, stats, on_survivor))
+			return;
+		if (limbs > 2 && limbs <= 4 && sieve_interval_fixed<4>(from, to, primes, stats, on_survivor))
+			return;
+		if (limbs > 4 && limbs <= 8 && sieve_interval_fixed<8>(from, to, primes, stats, on_survivor))
+			return;
+		if (limbs > 8 && limbs <= FIXED_UINT_MAX_LIMBS && sieve_interval_fixed<FIXED_UINT_MAX_LIMBS>(from, to, primes, stats, on_survivor))
+			return;
+	}
+	sieve_segment seg;
+	mpz_class candidate;
+	for (mpz_class base = from; base < to; base += seg.length) {
+		mpz_class remaining = to - base;
+		seg.length = mpz_cmp_ui(remaining.get_mpz_t(), SIEVE_SEGMENT_SIZE) < 0 ? remaining.get_ui() : SIEVE_SEGMENT_SIZE;
+		sieve_segment_fill(&seg, base, primes, stats);
+		for (uint64_t k = sieve_segment_next(&seg, 0); k < seg.length; k = sieve_segment_next(&seg, k + 1)) {
+			mpz_add_ui(candidate.get_mpz_t(), base.get_mpz_t(), k);
+			on_survivor(candidate);
+		}
+	}
+}
+
+/*
+* Same as `sieve_interval` for an interval [from, to) fitting in 64 bits, without any GMP value.
+*/
+template <typename F>
+void sieve_interval(uint64_t from, uint64_t to, const std::vector<uint32_t>* primes, sieve_stats* stats, F on_survivor) {
+	sieve_segment seg;
+	for (uint64_t base = from; base < to; base += seg.length) {
+		seg.length = to - base < SIEVE_SEGMENT_SIZE ? to - base : SIEVE_SEGMENT_SIZE;
+		sieve_segment_fill(&seg, base, primes, stats);
+		for (uint64_t k = sieve_segment_next(&seg, 0); k < seg.length; k = sieve_segment_next(&seg, k + 1))
+			on_survivor(base + k);
+	}
+}
+
+#endif //! SIEVE_HPP
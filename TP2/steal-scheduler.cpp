@@ -0,0 +1,145 @@
+/*
+ * Work stealing scheduler over splittable ranges of values, see steal-scheduler.hpp.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "steal-scheduler.hpp"
+#include "miller-rabin-gmp.hpp"
+
+StealScheduler::StealScheduler(int nb_workers, uint64_t grain)
+	: mDeques(nb_workers)
+	, mGrain(grain > 0 ? grain : 1)
+	, mIntervals(0) {
+	for (int i = 0; i < nb_workers; i++) {
+		pthread_mutex_init(&mDeques[i].mutex, NULL);
+		mDeques[i].stats = {0, 0};
+	}
+}
+
+StealScheduler::~StealScheduler() {
+	for (size_t i = 0; i < mDeques.size(); i++)
+		pthread_mutex_destroy(&mDeques[i].mutex);
+}
+
+void StealScheduler::add_interval(const mpz_class& from, const mpz_class& to) {
+	mpz_class base = from;
+	while (base < to) {
+		// Offsets are 64 bits, longer intervals are cut in several slices
+		mpz_class length = to - base;
+		if (!fits_u64(length))
+			length = UINT64_MAX;
+		size_t slice = mBases.size();
+		mBases.push_back(base);
+		mSliceIntervals.push_back(mIntervals);
+		mDeques[slice % mDeques.size()].ranges.push_back({slice, 0, mpz_get_ui(length.get_mpz_t())});
+		base += length;
+	}
+	mIntervals++;
+}
+
+void StealScheduler::plan(const cost_model* model) {
+	const size_t nb_workers = mDeques.size();
+	// Every range with its expected cost
+	std::vector<std::pair<double, steal_range>> ranges;
+	double total = 0;
+	mpz_class from, to;
+	for (worker_deque& d : mDeques) {
+		for (const steal_range& r : d.ranges) {
+			mpz_add_ui(from.get_mpz_t(), base(r.slice).get_mpz_t(), r.begin);
+			mpz_add_ui(to.get_mpz_t(), base(r.slice).get_mpz_t(), r.end);
+			double cost = cost_model_estimate(model, from, to);
+			ranges.push_back({cost, r});
+			total += cost;
+		}
+		d.ranges.clear();
+	}
+
+	// Split the ranges too expensive to be balanced, in parts of at least a piece
+	const double max_cost = total / (2 * nb_workers);
+	for (size_t i = 0, n = ranges.size(); i < n; i++) {
+		steal_range r = ranges[i].second;
+		double cost = ranges[i].first;
+		uint64_t length = r.end - r.begin;
+		uint64_t parts = max_cost > 0 ? (uint64_t) std::ceil(cost / max_cost) : 1;
+		parts = std::min(parts, std::max<uint64_t>(length / mGrain, 1));
+		if (parts <= 1)
+			continue;
+		uint64_t part = length / parts;
+		ranges[i] = {cost / parts, {r.slice, r.begin, r.begin + part}};
+		for (uint64_t k = 1; k < parts; k++)
+			ranges.push_back({cost / parts, {r.slice, r.begin + k * part, k + 1 == parts ? r.end : r.begin + (k + 1) * part}});
+	}
+
+	// Longest expected first, to the least loaded worker
+	std::stable_sort(ranges.begin(), ranges.end(), [](const std::pair<double, steal_range>& a, const std::pair<double, steal_range>& b) {
+		return a.first > b.first;
+	});
+	std::vector<double> loads(nb_workers, 0);
+	for (const std::pair<double, steal_range>& r : ranges) {
+		size_t w = std::min_element(loads.begin(), loads.end()) - loads.begin();
+		loads[w] += r.first;
+		// The owner works on the back: most expensive first
+		mDeques[w].ranges.push_front(r.second);
+	}
+}
+
+bool StealScheduler::next(int worker, steal_range* piece) {
+	worker_deque& own = mDeques[worker];
+	for (;;) {
+		pthread_mutex_lock(&own.mutex);
+		if (!own.ranges.empty()) {
+			// Cut a piece from the front of the last range, the rest can still be stolen
+			steal_range& r = own.ranges.back();
+			*piece = r;
+			if (r.end - r.begin > mGrain) {
+				piece->end = r.begin + mGrain;
+				r.begin += mGrain;
+			} else {
+				own.ranges.pop_back();
+			}
+			own.stats.pieces++;
+			pthread_mutex_unlock(&own.mutex);
+			return true;
+		}
+		pthread_mutex_unlock(&own.mutex);
+		if (!steal(worker))
+			return false;
+	}
+}
+
+/*
+* Move work from another worker to the deque of `worker`: the oldest range of a worker having
+* several, or the upper half of the only range of a worker if it is larger than a piece.
+* return : false if no worker had anything to steal.
+*/
+bool StealScheduler::steal(int worker) {
+	const int nb_workers = (int) mDeques.size();
+	for (int k = 1; k < nb_workers; k++) {
+		worker_deque& victim = mDeques[(worker + k) % nb_workers];
+		steal_range stolen;
+		pthread_mutex_lock(&victim.mutex);
+		if (victim.ranges.size() > 1) {
+			stolen = victim.ranges.front();
+			victim.ranges.pop_front();
+		} else if (victim.ranges.size() == 1 && victim.ranges.back().end - victim.ranges.back().begin > mGrain) {
+			steal_range& r = victim.ranges.back();
+			stolen = r;
+			stolen.begin = r.begin + (r.end - r.begin) / 2;
+			r.end = stolen.begin;
+		} else {
+			pthread_mutex_unlock(&victim.mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&victim.mutex);
+
+		worker_deque& own = mDeques[worker];
+		pthread_mutex_lock(&own.mutex);
+		own.ranges.push_back(stolen);
+		own.stats.steals++;
+		pthread_mutex_unlock(&own.mutex);
+		return true;
+	}
+	return false;
+}